@@ -0,0 +1,394 @@
+// Work Tracker Benchmarks
+// Generates synthetic histories and times the storage paths on them, so
+// a slower load, insert or render shows up as a number.
+//
+// Usage: worktracker-bench [DAYS...]   (default: 1000 100000 10000000)
+//        worktracker-bench gen DIR DAYS
+//
+// The tracker is built into this program with its main() renamed, so
+// the benchmarks call the same functions as the menu and the commands.
+
+#define main worktracker_main
+#include "worktracker.c"
+#undef main
+
+// One user's file holds at most this many days (about 380 years of
+// weekdays); larger histories are spread over more users of a store
+#define BENCH_DAYS_PER_USER 100000
+// Each benchmark repeats its operation for about this long
+#define BENCH_SECONDS 0.5
+#define BENCH_MAX_OPS 100000
+
+typedef struct {
+    char store[512];
+    char user_dir[600];  // the first user, whose file the benchmarks use
+    int first;           // day number of the first and last recorded day
+    int last;
+    size_t days;         // days in the first user's file
+    size_t users;
+} BenchHistory;
+
+typedef struct {
+    long long read;
+    long long written;
+} IoBytes;
+
+BenchHistory history;
+FILE *report;
+int devnull = -1;
+int saved_stdout = -1;
+uint64_t rng = 0x853C49E6748FEA9Bull;
+// Dates inserted by the insert benchmarks, for modify and delete
+int *inserted;
+size_t inserted_count;
+
+uint32_t bench_random() {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)(rng >> 16);
+}
+
+// A plausible day: arrival between 7:00 and 9:30, a lunch break, and
+// every eighth day an afternoon break as well
+void synthetic_day(int date, WorkDay *day) {
+    *day = (WorkDay){.date = date, .state = STATE_COMPLETED};
+    int arrival = 7 * 60 + bench_random() % 150;
+    int lunch = 12 * 60 + bench_random() % 60;
+    int back = lunch + 30 + bench_random() % 31;
+    int end = arrival + 8 * 60 + (back - lunch) + (int)(bench_random() % 91) - 45;
+    day->punches[day->punch_count++] = arrival;
+    day->punches[day->punch_count++] = lunch;
+    day->punches[day->punch_count++] = back;
+    if (bench_random() % 8 == 0) {
+        day->punches[day->punch_count++] = 15 * 60;
+        day->punches[day->punch_count++] = 15 * 60 + 15;
+    }
+    day->punches[day->punch_count++] = end;
+    calculate_day_totals(day);
+}
+
+// Write a data file of days weekdays from 1700-01-04 (a Monday) into the
+// data directory the paths point at, with its summary cache. Returns the
+// day number of the last day, or INT32_MIN on failure.
+int generate_file(size_t days) {
+    unsigned char *data = malloc(HEADER_SIZE + days * MAX_DAY_RECORDS * RECORD_SIZE);
+    if (!data) {
+        return INT32_MIN;
+    }
+    init_header(data);
+    size_t records = 0;
+    int date = days_from_civil(1700, 1, 4);
+    for (size_t i = 0; i < days; date++) {
+        if (weekday_of(date) >= 5) {
+            continue;
+        }
+        WorkDay day;
+        synthetic_day(date, &day);
+        records += encode_day(&day, data + HEADER_SIZE + records * RECORD_SIZE);
+        i++;
+    }
+    int ok = replace_data_file(data, HEADER_SIZE + records * RECORD_SIZE);
+    free(data);
+    if (!ok) {
+        return INT32_MIN;
+    }
+    remove(summary_file_path);
+    rebuild_summary();
+    return date - 1;
+}
+
+// Create a store in dir whose users hold days days in total
+int generate_history(const char *dir, size_t days) {
+    history = (BenchHistory){0};
+    snprintf(history.store, sizeof(history.store), "%s", dir);
+    history.users = (days + BENCH_DAYS_PER_USER - 1) / BENCH_DAYS_PER_USER;
+    history.days = days < BENCH_DAYS_PER_USER ? days : BENCH_DAYS_PER_USER;
+    history.first = days_from_civil(1700, 1, 4);
+
+    for (size_t u = 0; u < history.users; u++) {
+        char user[32];
+        snprintf(user, sizeof(user), "u%04zu", u);
+        if (!init_paths(history.store, user)) {
+            return 0;
+        }
+        size_t user_days = days - u * BENCH_DAYS_PER_USER;
+        int last = generate_file(user_days < BENCH_DAYS_PER_USER ? user_days : BENCH_DAYS_PER_USER);
+        if (last == INT32_MIN) {
+            printf("Error: Unable to write %s\n", data_file_path);
+            return 0;
+        }
+        if (u == 0) {
+            history.last = last;
+        }
+    }
+    snprintf(history.user_dir, sizeof(history.user_dir), "%s/%s/u0000", history.store, STORE_USERS_DIR);
+    set_data_dir(history.user_dir);
+    return 1;
+}
+
+// Remove a directory tree made by generate_history()
+void remove_tree(const char *path) {
+    DIR *dir = opendir(path);
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            char child[1024];
+            snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+            struct stat st;
+            if (lstat(child, &st) == 0 && S_ISDIR(st.st_mode)) {
+                remove_tree(child);
+            } else {
+                unlink(child);
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+// Bytes this process moved through read and write calls. Pages of the
+// mapped data file are not counted.
+void read_io(IoBytes *io) {
+    *io = (IoBytes){0};
+    FILE *f = fopen("/proc/self/io", "r");
+    if (!f) {
+        return;
+    }
+    char name[32];
+    long long value;
+    while (fscanf(f, "%31s %lld", name, &value) == 2) {
+        if (strcmp(name, "rchar:") == 0) {
+            io->read = value;
+        } else if (strcmp(name, "wchar:") == 0) {
+            io->written = value;
+        }
+    }
+    fclose(f);
+}
+
+// The tracker's own output goes to /dev/null while it is timed
+void mute_output() {
+    fflush(stdout);
+    dup2(devnull, STDOUT_FILENO);
+}
+
+void restore_output() {
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+}
+
+// Time op(i) for i = 0, 1... until BENCH_SECONDS have passed, max_ops
+// were run or op returns 0. Returns how many ran.
+size_t bench(const char *name, int (*op)(size_t), size_t max_ops) {
+    IoBytes before, after;
+    struct timespec start;
+    size_t ops = 0;
+
+    mute_output();
+    read_io(&before);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    double elapsed = 0;
+    while (ops < max_ops && elapsed < BENCH_SECONDS) {
+        if (!op(ops)) {
+            break;
+        }
+        ops++;
+        elapsed = seconds_since(&start);
+    }
+    read_io(&after);
+    restore_output();
+
+    // The /proc reads between the two samples are a few hundred bytes
+    double n = ops ? ops : 1;
+    fprintf(report, "%-24s %8zu %14.0f %14.0f %14.0f\n", name, ops, elapsed * 1e9 / n,
+            (after.read - before.read) / n, (after.written - before.written) / n);
+    fflush(report);
+    return ops;
+}
+
+int random_date() {
+    return history.first + bench_random() % (history.last - history.first + 1);
+}
+
+int op_load(size_t i) {
+    (void)i;
+    DataView view;
+    int ok = open_data_view(&view);
+    close_data_view(&view);
+    return ok;
+}
+
+int op_duplicate_check(size_t i) {
+    (void)i;
+    day_recorded(random_date(), NULL);
+    return 1;
+}
+
+// New days after the last one, the usual case of today's punch out
+int op_insert_append(size_t i) {
+    WorkDay day;
+    synthetic_day(history.last + 1 + i, &day);
+    save_completed_day(&day);
+    inserted[inserted_count++] = day.date;
+    return 1;
+}
+
+// Weekend days between recorded ones, which shift the records after them
+int op_insert_middle(size_t i) {
+    size_t weeks = (history.last - history.first) / 7;
+    if (i >= weeks) {
+        return 0;
+    }
+    // A prime stride visits the weeks in scattered order without repeats
+    size_t stride = weeks % 7919 ? 7919 : 7907;
+    WorkDay day;
+    synthetic_day(history.first + 5 + (i * stride % weeks) * 7, &day);
+    save_completed_day(&day);
+    inserted[inserted_count++] = day.date;
+    return 1;
+}
+
+// Same number of punches: the records are patched in place
+int op_modify(size_t i) {
+    if (i >= inserted_count) {
+        return 0;
+    }
+    WorkDay day;
+    synthetic_day(inserted[i], &day);
+    day.punches[0] -= 5;
+    calculate_day_totals(&day);
+    return store_day(&day);
+}
+
+// Two more breaks take another record, so the tail moves
+int op_modify_grow(size_t i) {
+    if (i >= inserted_count) {
+        return 0;
+    }
+    WorkDay day = {.date = inserted[i], .state = STATE_COMPLETED, .punch_count = 8,
+                   .punches = {480, 600, 615, 720, 750, 900, 915, 1000}};
+    calculate_day_totals(&day);
+    return store_day(&day);
+}
+
+int op_delete(size_t i) {
+    if (i >= inserted_count) {
+        return 0;
+    }
+    return delete_day(inserted[i]);
+}
+
+int op_history(size_t i) {
+    (void)i;
+    show_history();
+    return 1;
+}
+
+int op_totals_cached(size_t i) {
+    (void)i;
+    return show_balance();
+}
+
+int op_totals_rebuild(size_t i) {
+    (void)i;
+    remove(summary_file_path);
+    return show_balance();
+}
+
+int op_team(size_t i) {
+    (void)i;
+    int ok = show_team(INT32_MIN, INT32_MAX);
+    set_data_dir(history.user_dir);
+    return ok;
+}
+
+// Insert, modify and delete the same dates, so the file ends as it was
+void bench_changes(const char *insert_name, int (*insert)(size_t)) {
+    inserted_count = 0;
+    size_t ops = bench(insert_name, insert, BENCH_MAX_OPS);
+    bench("  modify (in place)", op_modify, ops);
+    bench("  modify (+1 record)", op_modify_grow, ops);
+    bench("  delete", op_delete, ops);
+}
+
+int run_benchmarks(size_t days) {
+    char dir[] = "/tmp/worktracker-bench-XXXXXX";
+    if (!mkdtemp(dir)) {
+        printf("Error: Unable to create a temporary directory\n");
+        return 0;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int ok = generate_history(dir, days);
+    if (!ok) {
+        remove_tree(dir);
+        return 0;
+    }
+
+    struct stat st;
+    stat(data_file_path, &st);
+    fprintf(report, "\n%zu days: %zu user%s, %zu days (%lld bytes) in the benchmarked file, generated in %.1f s\n",
+            days, history.users, history.users == 1 ? "" : "s", history.days, (long long)st.st_size,
+            seconds_since(&start));
+    fprintf(report, "%-24s %8s %14s %14s %14s\n", "benchmark", "ops", "ns/op", "read B/op", "written B/op");
+
+    bench("load", op_load, BENCH_MAX_OPS);
+    bench("duplicate check", op_duplicate_check, BENCH_MAX_OPS);
+    bench_changes("insert (append)", op_insert_append);
+    bench_changes("insert (middle)", op_insert_middle);
+    bench("history render", op_history, BENCH_MAX_OPS);
+    bench("totals (cached)", op_totals_cached, BENCH_MAX_OPS);
+    bench("totals (rebuilt)", op_totals_rebuild, BENCH_MAX_OPS);
+    bench("team totals", op_team, BENCH_MAX_OPS);
+
+    remove_tree(dir);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "gen") == 0) {
+        if (argc != 4 || atol(argv[3]) <= 0) {
+            printf("Usage: worktracker-bench gen DIR DAYS\n");
+            return 1;
+        }
+        mkdir(argv[2], 0755);
+        if (!generate_history(argv[2], atol(argv[3]))) {
+            return 1;
+        }
+        printf("✓ Wrote %s days for %zu user%s to %s/%s\n", argv[3], history.users,
+               history.users == 1 ? "" : "s", argv[2], STORE_USERS_DIR);
+        return 0;
+    }
+
+    devnull = open("/dev/null", O_WRONLY);
+    saved_stdout = dup(STDOUT_FILENO);
+    report = fdopen(saved_stdout, "w");
+    inserted = malloc(BENCH_MAX_OPS * sizeof(int));
+    if (devnull < 0 || !report || !inserted) {
+        printf("Error: Unable to set up the benchmarks\n");
+        return 1;
+    }
+
+    static const size_t default_days[] = {1000, 100000, 10000000};
+    int ok = 1;
+    if (argc > 1) {
+        for (int i = 1; i < argc && ok; i++) {
+            if (atol(argv[i]) <= 0) {
+                printf("Usage: worktracker-bench [DAYS...]\n");
+                return 1;
+            }
+            ok = run_benchmarks(atol(argv[i]));
+        }
+    } else {
+        for (size_t i = 0; i < sizeof(default_days) / sizeof(default_days[0]) && ok; i++) {
+            ok = run_benchmarks(default_days[i]);
+        }
+    }
+    free(inserted);
+    return ok ? 0 : 1;
+}
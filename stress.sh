@@ -0,0 +1,113 @@
+#!/bin/bash
+
+# Work Tracker Concurrency Stress Test
+# Runs many writers and readers against one data file at the same time
+# and checks that no update was lost.
+#
+# Usage: ./stress.sh [writers] [days per writer]
+
+set -e
+
+WRITERS=${1:-32}
+DAYS=${2:-25}
+IMPORTERS=2
+BIN="$(cd "$(dirname "$0")" && pwd)/worktracker"
+
+GREEN='\033[0;32m'
+RED='\033[0;31m'
+NC='\033[0m' # No Color
+
+if [ ! -x "$BIN" ]; then
+    echo -e "${RED}✗ $BIN not found, run make first${NC}"
+    exit 1
+fi
+
+# Work in a throwaway home so real data is never touched
+export HOME="$(mktemp -d)"
+mkdir -p "$HOME/.local/bin"
+trap 'rm -rf "$HOME"' EXIT
+
+# Day number N after 2000-01-01 as YYYY-MM-DD
+day() {
+    date -u -d "2000-01-01 +$1 days" +%Y-%m-%d
+}
+
+# Each writer adds its own days, in shuffled order so most of them land
+# between existing days and shift the records after them
+writer() {
+    local w=$1
+    for k in $(shuf -i 0-$((DAYS - 1))); do
+        printf '2\n%s\n08:00\n12:00\n12:30\n17:00\n8\n' "$(day $((k * WRITERS + w)))" |
+            "$BIN" > /dev/null
+    done
+}
+
+# Importers replace the whole file while the writers patch it in place
+importer() {
+    local i=$1
+    for k in $(seq 0 $((DAYS - 1))); do
+        echo "$(day $((WRITERS * DAYS + k * IMPORTERS + i))),07:30,12:00,12:45,16:30"
+    done | "$BIN" import - > /dev/null
+}
+
+# Readers must never see a damaged file
+reader() {
+    while [ ! -f "$HOME/done" ]; do
+        if "$BIN" balance | grep -q Error || "$BIN" export | grep -q Error; then
+            touch "$HOME/reader_failed"
+        fi
+    done
+}
+
+echo "Running $WRITERS writers x $DAYS days, $IMPORTERS importers and 4 readers..."
+start=$(date +%s%N)
+
+readers=()
+for r in 1 2 3 4; do
+    reader &
+    readers+=($!)
+done
+
+pids=()
+for w in $(seq 0 $((WRITERS - 1))); do
+    writer $w &
+    pids+=($!)
+done
+for i in $(seq 0 $((IMPORTERS - 1))); do
+    importer $i &
+    pids+=($!)
+done
+wait "${pids[@]}"
+touch "$HOME/done"
+wait "${readers[@]}"
+
+elapsed_ms=$((($(date +%s%N) - start) / 1000000))
+expected=$(((WRITERS + IMPORTERS) * DAYS))
+rows=$("$BIN" export | tail -n +2 | wc -l)
+unique=$("$BIN" export | tail -n +2 | cut -d, -f1 | sort -u | wc -l)
+
+# The cached totals must match totals rebuilt from the records
+cached=$("$BIN" balance)
+rm -f "$HOME/.local/bin/worktracker.sum"
+rebuilt=$("$BIN" balance)
+
+echo "Days expected: $expected, stored: $rows ($unique distinct) in ${elapsed_ms} ms"
+
+failed=0
+if [ "$rows" -ne "$expected" ] || [ "$unique" -ne "$expected" ]; then
+    echo -e "${RED}✗ Lost or duplicated updates${NC}"
+    failed=1
+fi
+if [ -f "$HOME/reader_failed" ]; then
+    echo -e "${RED}✗ A reader saw a damaged data file${NC}"
+    failed=1
+fi
+if [ "$cached" != "$rebuilt" ]; then
+    echo -e "${RED}✗ Cached totals do not match the data file${NC}"
+    failed=1
+fi
+
+if [ $failed -eq 0 ]; then
+    echo -e "${GREEN}✓ No lost updates${NC}"
+fi
+exit $failed
@@ -20,6 +20,13 @@ DATA_DIR="$HOME/.local/bin"
 WORKTRACKER_BIN="$BIN_DIR/worktracker"
 DATA_FILE="$DATA_DIR/worktracker.dat"
 TEMP_FILE="$DATA_DIR/temp_day.tmp"
+TEMP_LOCK_FILE="$DATA_DIR/temp_day.lock"
+SUMMARY_FILE="$DATA_DIR/worktracker.sum"
+JOURNAL_FILE="$DATA_DIR/worktracker.jnl"
+SOCKET_FILE="$DATA_DIR/worktracker.sock"
+STATUS_FILE="$DATA_DIR/worktracker.status"
+LOG_FILE="$DATA_DIR/worktracker.log"
+SNAPSHOT_DIR="$DATA_DIR/snapshots"
 
 echo -e "${YELLOW}This will remove worktracker from your system.${NC}"
 echo ""
@@ -108,6 +115,18 @@ if [ "$HAS_DATA" = true ]; then
                 echo -e "${RED}✗ Failed to remove $TEMP_FILE${NC}"
             fi
         fi
+
+        if [ -d "$SNAPSHOT_DIR" ]; then
+            if rm -rf "$SNAPSHOT_DIR"; then
+                echo -e "${GREEN}✓ Removed $SNAPSHOT_DIR${NC}"
+            else
+                echo -e "${RED}✗ Failed to remove $SNAPSHOT_DIR${NC}"
+            fi
+        fi
+
+        # Caches, the rollback journal, the change log, the lock of the day
+        # in progress and the daemon socket
+        rm -f "$SUMMARY_FILE" "$STATUS_FILE" "$JOURNAL_FILE" "$LOG_FILE" "$TEMP_LOCK_FILE" "$SOCKET_FILE"
     else
         echo -e "${GREEN}✓ Data files preserved${NC}"
         echo -e "${YELLOW}Your data is still at:${NC}"
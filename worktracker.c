@@ -1,28 +1,150 @@
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <stdint.h>
 #include <time.h>
 #include <signal.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
 #include <pwd.h>
+#include <dirent.h>
 
 #define DATA_DIR ".local/bin"
+#define STORE_USERS_DIR "users"
 #define DATA_FILE_NAME "worktracker.dat"
 #define TEMP_FILE_NAME "temp_day.tmp"
+#define TEMP_LOCK_FILE_NAME "temp_day.lock"
+#define SUMMARY_FILE_NAME "worktracker.sum"
+#define JOURNAL_FILE_NAME "worktracker.jnl"
+#define SOCKET_FILE_NAME "worktracker.sock"
+#define STATUS_FILE_NAME "worktracker.status"
+#define SCHEDULE_FILE_NAME "worktracker.conf"
+#define LOG_FILE_NAME "worktracker.log"
+// Daily target when the schedule file does not set one
 #define REQUIRED_HOURS 7
 #define REQUIRED_MINUTES 48
 
+// Punch times count minutes from midnight of the day a shift started,
+// so a night shift ends past MINUTES_PER_DAY. A clock time before the
+// previous punch is only taken as after midnight without being written
+// HH:MM+1 if that puts it at most MAX_MIDNIGHT_GAP later, so a typo
+// such as 07:00 for 17:00 is not recorded as a 23-hour shift.
+#define MINUTES_PER_DAY (24 * 60)
+#define MAX_MIDNIGHT_GAP (12 * 60)
+// An in-progress shift from yesterday whose last punch is older than
+// this was left open, and today starts a new day
+#define MAX_PUNCH_GAP (16 * 60)
+
+// On-disk format: a header followed by fixed-size little-endian records.
+// Worked and excess minutes are derived, so they are not stored.
+//   header: "WTRK" | u16 version | u16 record size | u32 generation
+//           (bumped on every change) | u32 file id | u32 checksum (sum of
+//           record_hash() over the records) | reserved (zero)
+//   record: i32 days since 1970-01-01 | u16 in | u16 out | u16 in
+//           | u16 out (minutes after midnight, NO_PUNCH when unused)
+// A day with more than two work periods continues in the next records,
+// which carry the same date, so the records stay sorted by date and a
+// day is found by binary search for its first record.
+// Version 1 files have no checksum and version 2 files hold one record
+// per day; both are upgraded when opened.
+#define DATA_MAGIC "WTRK"
+#define DATA_VERSION 3
+#define HEADER_SIZE 32
+#define RECORD_SIZE 12
+#define NO_PUNCH 0xFFFF
+
+// Per-month totals cached next to the data file (see load_summary())
+#define SUMMARY_MAGIC "WTSM"
+#define SUMMARY_VERSION 2
+#define SUMMARY_HEADER_SIZE 20
+#define SUMMARY_MONTH_SIZE 16
+
+// Rollback journal for in-place changes (see begin_change())
+#define JOURNAL_MAGIC "WTJN"
+#define JOURNAL_HEADER_SIZE 24
+
+// Change log: the records of a day before and after each change, for
+// undo, redo and restoring an earlier point in time (see append_log())
+//   header: "WTLG" | u16 version | u16 reserved | u32 cursor (end of the
+//           changes in effect; the ones after it were undone) | u32
+//           snapshot mark (the cursor at the last snapshot, 0 once undo
+//           went back past it; see take_snapshot())
+//   entry:  u32 time | i32 date | u8 LogKind | u8 flags | u8 records
+//           before | u8 records after | records before | records after
+//           | u16 entry size (to step back over it)
+// One command's changes form a group, undone and redone together, whose
+// entries share a time and have different dates.
+#define LOG_MAGIC "WTLG"
+#define LOG_VERSION 1
+#define LOG_HEADER_SIZE 16
+#define LOG_ENTRY_HEADER_SIZE 12
+#define LOG_ENTRY_MAX (LOG_ENTRY_HEADER_SIZE + 2 * MAX_DAY_RECORDS * RECORD_SIZE + 2)
+#define LOG_GROUP_START 1
+
+// Backups of the data file (see take_snapshot()), by default in a
+// directory next to it. A full snapshot holds every record, the next
+// ones only the days changed since the one before.
+//   header: "WTSN" | u16 version | u16 record size | u32 sequence number
+//           | u32 data file id | u32 data file generation | u32 data
+//           file checksum | u32 change log cursor | u32 checksum of the
+//           records below | u32 flags | reserved
+//   records: sorted by date, as in the data file; a day deleted since
+//           the previous snapshot is one record without punches
+#define SNAPSHOT_DIR_NAME "snapshots"
+#define SNAPSHOT_MAGIC "WTSN"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_HEADER_SIZE 40
+#define SNAPSHOT_FULL 1
+
+typedef enum {
+    LOG_DAY,     // a day saved, modified or deleted
+    LOG_IMPORT,
+    LOG_RESET
+} LogKind;
+
 typedef enum {
     STATE_NEW,
-    STATE_STARTED,
-    STATE_LUNCH_START,
-    STATE_LUNCH_END,
+    STATE_STARTED,      // working, no break yet
+    STATE_LUNCH_START,  // on a break
+    STATE_LUNCH_END,    // back from a break
     STATE_COMPLETED
 } DayState;
 
+// Clock-ins and clock-outs of one day, so at most 7 breaks
+#define MAX_PUNCHES 16
+// Records a day takes at most in the data file (two punches per u16 pair)
+#define MAX_DAY_RECORDS (MAX_PUNCHES / 4)
+
+typedef struct {
+    int date;  // days since 1970-01-01, see format_date()
+    DayState state;
+    int punch_count;
+    int punches[MAX_PUNCHES];  // minutes after midnight: in, out, in, out...
+    int worked_minutes;
+    int excess_minutes;
+} WorkDay;
+
+// In-progress day as saved before days could have several breaks
 typedef struct {
-    char date[11];  // YYYY-MM-DD
+    int date;
+    DayState state;
+    int times[8];  // hour and minute of arrival, lunch start, lunch end, end
+    int worked_minutes;
+    int excess_minutes;
+} FixedWorkDay;
+
+// Record layout of data files written before the versioned format
+typedef struct {
+    char date[11];
     DayState state;
     int start_hour;
     int start_min;
@@ -34,52 +156,378 @@ typedef struct {
     int end_min;
     int worked_minutes;
     int excess_minutes;
-} WorkDay;
+} LegacyWorkDay;
+
+// Read-only view of the data file, mapped in place of a heap copy. A
+// view from open_data_view() keeps the file locked until it is closed.
+typedef struct {
+    int fd;  // -1 when the view does not own a descriptor
+    void *map;
+    size_t size;
+    const unsigned char *records;
+    size_t count;
+    uint32_t generation;
+    uint32_t file_id;
+    uint32_t checksum;
+} DataView;
+
+typedef struct {
+    int32_t month;  // year * 12 + month - 1
+    int32_t days;
+    int32_t worked;
+    int32_t excess;
+} MonthTotals;
+
+// Worked and excess minutes per month and in total
+typedef struct {
+    uint32_t generation;  // data file generation the totals belong to
+    uint32_t file_id;
+    MonthTotals *months;
+    size_t count;
+    size_t capacity;
+    int days;
+    long long worked;
+    long long excess;
+} Summary;
+
+// Required minutes of every day, compiled from the schedule file into a
+// table indexed by day number, so a lookup is one array access whatever
+// the rules. Before and after the table the first and the last weekly
+// targets repeat.
+typedef struct {
+    int loaded;
+    int first;        // day number of table[0]
+    int count;
+    uint16_t *table;
+    int before[7];    // weekly targets, Monday first
+    int after[7];
+    uint32_t hash;    // identifies the targets, for caches that depend on them
+} Schedule;
 
 WorkDay current_day;
 int is_editing = 0;
 char data_file_path[512];
 char temp_file_path[512];
+char temp_lock_file_path[512];
+char summary_file_path[512];
+char journal_file_path[512];
+char socket_file_path[512];
+char status_file_path[512];
+char schedule_file_path[512];
+char log_file_path[512];
+char snapshot_dir_path[512];
+char store_path[256];  // shared store directory, empty for a personal one
+Schedule schedule;
+
+void free_schedule() {
+    free(schedule.table);
+    schedule = (Schedule){0};
+}
 
-void init_paths() {
+// Point every file path at the files of one data directory
+void set_data_dir(const char *dir) {
+    snprintf(data_file_path, sizeof(data_file_path), "%s/%s", dir, DATA_FILE_NAME);
+    snprintf(temp_file_path, sizeof(temp_file_path), "%s/%s", dir, TEMP_FILE_NAME);
+    snprintf(temp_lock_file_path, sizeof(temp_lock_file_path), "%s/%s", dir, TEMP_LOCK_FILE_NAME);
+    snprintf(summary_file_path, sizeof(summary_file_path), "%s/%s", dir, SUMMARY_FILE_NAME);
+    snprintf(journal_file_path, sizeof(journal_file_path), "%s/%s", dir, JOURNAL_FILE_NAME);
+    snprintf(socket_file_path, sizeof(socket_file_path), "%s/%s", dir, SOCKET_FILE_NAME);
+    snprintf(status_file_path, sizeof(status_file_path), "%s/%s", dir, STATUS_FILE_NAME);
+    snprintf(schedule_file_path, sizeof(schedule_file_path), "%s/%s", dir, SCHEDULE_FILE_NAME);
+    snprintf(log_file_path, sizeof(log_file_path), "%s/%s", dir, LOG_FILE_NAME);
+    snprintf(snapshot_dir_path, sizeof(snapshot_dir_path), "%s/%s", dir, SNAPSHOT_DIR_NAME);
+    free_schedule();
+}
+
+// User names become directory names in the store
+int valid_user_name(const char *name) {
+    size_t len = strlen(name);
+    if (len == 0 || len > 64 || name[0] == '.') {
+        return 0;
+    }
+    for (size_t i = 0; i < len; i++) {
+        char c = name[i];
+        if (!(c >= 'a' && c <= 'z') && !(c >= 'A' && c <= 'Z') &&
+            !(c >= '0' && c <= '9') && c != '.' && c != '_' && c != '-') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Create a directory of the store that every member of its group can
+// add partitions to: group-writable, and setgid so that what is created
+// inside gets the store's group rather than each user's own
+void make_store_dir(const char *path) {
+    if (mkdir(path, 0770) == 0) {
+        chmod(path, 02770);
+    }
+}
+
+// Use the personal data directory under $HOME, or with a store (from
+// --store or WORKTRACKER_STORE) the partition of one user in it:
+// STORE/users/NAME/. Returns 0 if the user name is not usable or the
+// directory cannot be created.
+int init_paths(const char *store, const char *user) {
+    if (!store) {
+        store = getenv("WORKTRACKER_STORE");
+    }
+    if (!user) {
+        user = getenv("WORKTRACKER_USER");
+    }
+
+    // The password database can be slow (NSS, LDAP): only read it if needed
     const char *home = getenv("HOME");
-    if (!home) {
+    if (!home || (store && *store && !user)) {
         struct passwd *pw = getpwuid(getuid());
-        home = pw->pw_dir;
+        if (!home) {
+            home = pw->pw_dir;
+        }
+        if (!user && pw) {
+            user = pw->pw_name;
+        }
     }
-    
-    // Create full path
-    snprintf(data_file_path, sizeof(data_file_path), "%s/%s/%s", home, DATA_DIR, DATA_FILE_NAME);
-    snprintf(temp_file_path, sizeof(temp_file_path), "%s/%s/%s", home, DATA_DIR, TEMP_FILE_NAME);
-    
-    // Create directory if it doesn't exist
+
     char dir_path[512];
-    snprintf(dir_path, sizeof(dir_path), "%s/%s", home, DATA_DIR);
-    
+    if (store && *store) {
+        if (!user || !valid_user_name(user)) {
+            printf("Error: Invalid user name '%s' (letters, digits, '.', '_' and '-')\n", user ? user : "");
+            return 0;
+        }
+        if (strlen(store) >= sizeof(store_path)) {
+            printf("Error: Store path is too long\n");
+            return 0;
+        }
+        snprintf(store_path, sizeof(store_path), "%s", store);
+        snprintf(dir_path, sizeof(dir_path), "%s/%s", store_path, STORE_USERS_DIR);
+        make_store_dir(store_path);
+        make_store_dir(dir_path);
+        snprintf(dir_path, sizeof(dir_path), "%s/%s/%s", store_path, STORE_USERS_DIR, user);
+    } else {
+        store_path[0] = '\0';
+        snprintf(dir_path, sizeof(dir_path), "%s/%s", home, DATA_DIR);
+    }
+    set_data_dir(dir_path);
+
+    // Create directory if it doesn't exist
     struct stat st = {0};
-    if (stat(dir_path, &st) == -1) {
-        mkdir(dir_path, 0700);
+    if (stat(dir_path, &st) == -1 && mkdir(dir_path, 0700) != 0 && store_path[0]) {
+        printf("Error: Unable to create %s (%s)\n", dir_path, strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+// Answers to the prompts, read from standard input a block at a time
+// rather than through scanf(), so that a script can feed thousands of
+// them through a pipe. ended is set once there is nothing left.
+struct {
+    char data[1 << 16];
+    size_t start, end;
+    int closed;
+    int ended;
+} input;
+
+// Read the next line of input into line, without the newline and the
+// spaces around it. Returns 1, 0 at the end of input, or -1 if the line
+// does not fit (it is skipped and line left empty, so that no part of it
+// passes for an answer).
+int read_line(char *line, size_t size) {
+    fflush(stdout);
+    size_t len = 0;
+    int got = 0, cut = 0;
+    while (1) {
+        char *start = input.data + input.start;
+        char *newline = memchr(start, '\n', input.end - input.start);
+        size_t avail = newline ? (size_t)(newline - start) : input.end - input.start;
+        size_t copy = avail < size - 1 - len ? avail : size - 1 - len;
+        memcpy(line + len, start, copy);
+        len += copy;
+        cut |= copy < avail;
+        got |= avail > 0 || newline;
+        if (newline) {
+            input.start += avail + 1;
+            break;
+        }
+        input.start = input.end = 0;
+        if (input.closed) {
+            break;
+        }
+        ssize_t n = read(STDIN_FILENO, input.data, sizeof(input.data));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            input.closed = 1;
+        } else {
+            input.end = n;
+        }
+    }
+    if (!got) {
+        input.ended = 1;
+        return 0;
+    }
+    if (cut) {
+        line[0] = '\0';
+        return -1;
+    }
+    while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t' || line[len - 1] == '\r')) {
+        len--;
+    }
+    line[len] = '\0';
+    size_t skip = strspn(line, " \t");
+    memmove(line, line + skip, len - skip + 1);
+    return 1;
+}
+
+// Read a whole number on a line of its own. Returns 0 if the line holds
+// anything else, or at the end of input.
+int read_number(int *value) {
+    char line[16];
+    if (read_line(line, sizeof(line)) != 1) {
+        return 0;
+    }
+    char *end;
+    errno = 0;
+    long number = strtol(line, &end, 10);
+    if (end == line || *end != '\0' || errno != 0 || number < -999999 || number > 999999) {
+        return 0;
+    }
+    *value = number;
+    return 1;
+}
+
+// Read a y/n answer: anything not starting with y is no
+int read_yes() {
+    char line[8];
+    return read_line(line, sizeof(line)) == 1 && (line[0] == 'y' || line[0] == 'Y');
+}
+
+// Days since 1970-01-01 for a date in the proleptic Gregorian calendar
+int days_from_civil(int year, int month, int mday) {
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int yoe = year - era * 400;
+    int doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + mday - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+void civil_from_days(int days, int *year, int *month, int *mday) {
+    days += 719468;
+    int era = (days >= 0 ? days : days - 146096) / 146097;
+    int doe = days - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    *mday = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = yoe + era * 400 + (*month <= 2);
+}
+
+// Parse YYYY-MM-DD into a day number. Returns 0 if it is not a real date.
+int parse_date(const char *text, int *days) {
+    for (int i = 0; i < 10; i++) {
+        if (i == 4 || i == 7) {
+            if (text[i] != '-') {
+                return 0;
+            }
+        } else if (text[i] < '0' || text[i] > '9') {
+            return 0;
+        }
+    }
+    if (text[10] != '\0') {
+        return 0;
+    }
+
+    int year = (text[0] - '0') * 1000 + (text[1] - '0') * 100 + (text[2] - '0') * 10 + (text[3] - '0');
+    int month = (text[5] - '0') * 10 + (text[6] - '0');
+    int mday = (text[8] - '0') * 10 + (text[9] - '0');
+    if (month < 1 || month > 12 || mday < 1) {
+        return 0;
     }
+
+    int next_month = month == 12 ? days_from_civil(year + 1, 1, 1) : days_from_civil(year, month + 1, 1);
+    *days = days_from_civil(year, month, mday);
+    return *days < next_month;
 }
 
-void clear_input_buffer() {
-    int c;
-    while ((c = getchar()) != '\n' && c != EOF);
+// Format a day number as YYYY-MM-DD into an 11-byte buffer
+void format_date(int days, char *text) {
+    int year, month, mday;
+    civil_from_days(days, &year, &month, &mday);
+    text[0] = '0' + year / 1000 % 10;
+    text[1] = '0' + year / 100 % 10;
+    text[2] = '0' + year / 10 % 10;
+    text[3] = '0' + year % 10;
+    text[4] = '-';
+    text[5] = '0' + month / 10;
+    text[6] = '0' + month % 10;
+    text[7] = '-';
+    text[8] = '0' + mday / 10;
+    text[9] = '0' + mday % 10;
+    text[10] = '\0';
 }
 
-void get_current_date(char *date) {
+// Today's local date as a day number
+int get_current_date() {
     time_t now = time(NULL);
     struct tm *t = localtime(&now);
-    strftime(date, 11, "%Y-%m-%d", t);
+    return days_from_civil(t->tm_year + 1900, t->tm_mon + 1, t->tm_mday);
 }
 
 int time_to_minutes(int hour, int min) {
     return hour * 60 + min;
 }
 
-void minutes_to_time(int total_minutes, int *hour, int *min) {
-    *hour = total_minutes / 60;
-    *min = total_minutes % 60;
+// Parse H:MM or HH:MM into minutes after midnight. Returns 0 if invalid.
+int parse_time(const char *text, int *minutes) {
+    int hour = 0, min = 0, i = 0;
+    if (text[i] < '0' || text[i] > '9') {
+        return 0;
+    }
+    hour = text[i++] - '0';
+    if (text[i] >= '0' && text[i] <= '9') {
+        hour = hour * 10 + (text[i++] - '0');
+    }
+    if (text[i++] != ':' ||
+        text[i] < '0' || text[i] > '9' || text[i + 1] < '0' || text[i + 1] > '9' ||
+        text[i + 2] != '\0') {
+        return 0;
+    }
+    min = (text[i] - '0') * 10 + (text[i + 1] - '0');
+    if (hour > 23 || min > 59) {
+        return 0;
+    }
+    *minutes = time_to_minutes(hour, min);
+    return 1;
+}
+
+// Parse a punch time: HH:MM, or HH:MM+1 for the day after the shift
+// started. Returns 0 if invalid.
+int parse_punch_time(const char *text, int *minutes) {
+    char clock[8];
+    const char *plus = strchr(text, '+');
+    size_t len = plus ? (size_t)(plus - text) : strlen(text);
+    if (len >= sizeof(clock) || (plus && strcmp(plus, "+1") != 0)) {
+        return 0;
+    }
+    memcpy(clock, text, len);
+    clock[len] = '\0';
+    if (!parse_time(clock, minutes)) {
+        return 0;
+    }
+    if (plus) {
+        *minutes += MINUTES_PER_DAY;
+    }
+    return 1;
+}
+
+// Format a punch time as HH:MM, with "+1" when it falls on the day
+// after the shift started, into an 8-byte buffer
+void format_punch(int minutes, char *text) {
+    unsigned clock = (unsigned)minutes % MINUTES_PER_DAY;
+    snprintf(text, 8, "%02u:%02u%s", clock / 60, clock % 60, minutes >= MINUTES_PER_DAY ? "+1" : "");
 }
 
 void print_time_diff(int minutes) {
@@ -92,863 +540,4996 @@ void print_time_diff(int minutes) {
     }
 }
 
-int load_temp_day(WorkDay *day) {
-    FILE *file = fopen(temp_file_path, "rb");
-    if (!file) {
-        return 0;
+// Bytes waiting to be sent on a non-blocking socket
+typedef struct {
+    char *data;
+    size_t len;
+    size_t sent;
+    size_t capacity;
+} OutQueue;
+
+// Returns 0 if out of memory
+int queue_bytes(OutQueue *queue, const char *bytes, size_t n) {
+    if (queue->len + n > queue->capacity) {
+        size_t capacity = queue->capacity ? queue->capacity : 4096;
+        while (capacity < queue->len + n) {
+            capacity *= 2;
+        }
+        char *grown = realloc(queue->data, capacity);
+        if (!grown) {
+            return 0;
+        }
+        queue->data = grown;
+        queue->capacity = capacity;
     }
-    
-    int result = fread(day, sizeof(WorkDay), 1, file);
-    fclose(file);
-    
-    // Check if it's the same day
-    char today[11];
-    get_current_date(today);
-    if (strcmp(day->date, today) != 0) {
-        remove(temp_file_path);
-        return 0;
+    memcpy(queue->data + queue->len, bytes, n);
+    queue->len += n;
+    return 1;
+}
+
+// Output collected in a large buffer and written in few system calls, or
+// with queue set, moved to the queue to be sent later
+typedef struct {
+    int fd;
+    OutQueue *queue;
+    int failed;
+    size_t len;
+    char data[1 << 16];
+} OutBuf;
+
+void out_flush(OutBuf *out) {
+    if (out->queue) {
+        out->failed |= out->len > 0 && !queue_bytes(out->queue, out->data, out->len);
+        out->len = 0;
+        return;
     }
-    
-    return result == 1;
+    size_t done = 0;
+    while (done < out->len && !out->failed) {
+        ssize_t n = write(out->fd, out->data + done, out->len - done);
+        if (n <= 0) {
+            out->failed = 1;
+        } else {
+            done += n;
+        }
+    }
+    out->len = 0;
 }
 
-void save_temp_day(WorkDay *day) {
-    FILE *file = fopen(temp_file_path, "wb");
-    if (file) {
-        fwrite(day, sizeof(WorkDay), 1, file);
-        fclose(file);
+void out_bytes(OutBuf *out, const char *bytes, size_t n) {
+    if (out->len + n > sizeof(out->data)) {
+        out_flush(out);
+        if (n > sizeof(out->data) && out->queue) {
+            out->failed |= !queue_bytes(out->queue, bytes, n);
+            return;
+        }
+        if (n > sizeof(out->data)) {
+            out->len = 0;
+            while (n > 0 && !out->failed) {
+                ssize_t w = write(out->fd, bytes, n);
+                if (w <= 0) {
+                    out->failed = 1;
+                } else {
+                    bytes += w;
+                    n -= w;
+                }
+            }
+            return;
+        }
     }
+    memcpy(out->data + out->len, bytes, n);
+    out->len += n;
 }
 
-void delete_temp_day() {
-    remove(temp_file_path);
+void out_str(OutBuf *out, const char *text) {
+    out_bytes(out, text, strlen(text));
 }
 
-void signal_handler(int signum) {
-    if (signum == SIGINT && is_editing) {
-        printf("\n\n✓ Saving...\n");
-        save_temp_day(&current_day);
-        printf("✓ Data saved! You can continue later.\n");
-        exit(0);
+void out_int(OutBuf *out, int value) {
+    char digits[12];
+    int n = sizeof(digits);
+    unsigned v = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+    do {
+        digits[--n] = '0' + v % 10;
+        v /= 10;
+    } while (v > 0);
+    if (value < 0) {
+        digits[--n] = '-';
     }
+    out_bytes(out, digits + n, sizeof(digits) - n);
 }
 
-void save_completed_day(WorkDay *day) {
-    // Calculate worked minutes
-    int start_minutes = time_to_minutes(day->start_hour, day->start_min);
-    int lunch_start_minutes = time_to_minutes(day->lunch_start_hour, day->lunch_start_min);
-    int lunch_end_minutes = time_to_minutes(day->lunch_end_hour, day->lunch_end_min);
-    int end_minutes = time_to_minutes(day->end_hour, day->end_min);
+// Integer right-aligned in a field of the given width
+void out_int_width(OutBuf *out, int value, int width) {
+    int digits = value < 0 ? 2 : 1;
+    for (int v = abs(value); v >= 10; v /= 10) {
+        digits++;
+    }
+    for (; digits < width; digits++) {
+        out_bytes(out, " ", 1);
+    }
+    out_int(out, value);
+}
 
-    int morning_work = lunch_start_minutes - start_minutes;
-    int afternoon_work = end_minutes - lunch_end_minutes;
-    day->worked_minutes = morning_work + afternoon_work;
+// Minutes after midnight as HH:MM
+void out_clock(OutBuf *out, int minutes) {
+    char text[5] = {
+        '0' + minutes / 600 % 10, '0' + minutes / 60 % 10, ':',
+        '0' + minutes % 60 / 10, '0' + minutes % 10
+    };
+    out_bytes(out, text, sizeof(text));
+}
 
-    int required_minutes = REQUIRED_HOURS * 60 + REQUIRED_MINUTES;
-    day->excess_minutes = day->worked_minutes - required_minutes;
+// A punch time like format_punch(). Returns the length written.
+int out_punch(OutBuf *out, int minutes) {
+    out_clock(out, minutes % MINUTES_PER_DAY);
+    if (minutes >= MINUTES_PER_DAY) {
+        out_bytes(out, "+1", 2);
+        return 7;
+    }
+    return 5;
+}
 
-    day->state = STATE_COMPLETED;
+void out_date(OutBuf *out, int date) {
+    char text[11];
+    format_date(date, text);
+    out_bytes(out, text, 10);
+}
 
-    // Load all existing entries
-    FILE *read_file = fopen(data_file_path, "rb");
-    WorkDay *entries = NULL;
-    int count = 0;
-    int capacity = 10;
-
-    if (read_file) {
-        entries = malloc(capacity * sizeof(WorkDay));
-        WorkDay temp;
-        while (fread(&temp, sizeof(WorkDay), 1, read_file) == 1) {
-            // Don't copy if we're replacing this date
-            if (strcmp(temp.date, day->date) != 0) {
-                if (count >= capacity) {
-                    capacity *= 2;
-                    entries = realloc(entries, capacity * sizeof(WorkDay));
-                }
-                entries[count++] = temp;
-            }
-        }
-        fclose(read_file);
-    } else {
-        entries = malloc(capacity * sizeof(WorkDay));
+// Duration as HH:MM (hours may run past 99). Returns the length written.
+int out_duration(OutBuf *out, int minutes) {
+    int len = 4;
+    if (minutes / 60 < 10) {
+        out_bytes(out, "0", 1);
+        len++;
+    }
+    for (int v = minutes / 60; v >= 10; v /= 10) {
+        len++;
     }
+    out_int(out, minutes / 60);
+    char text[3] = {':', '0' + minutes % 60 / 10, '0' + minutes % 10};
+    out_bytes(out, text, sizeof(text));
+    return len;
+}
 
-    // Insert new entry in chronological order
-    int insert_pos = count;
-    for (int i = 0; i < count; i++) {
-        if (strcmp(day->date, entries[i].date) < 0) {
-            insert_pos = i;
-            break;
+// Signed duration as +HH:MM / -HH:MM, like print_time_diff()
+int out_time_diff(OutBuf *out, int minutes) {
+    out_bytes(out, minutes >= 0 ? "+" : "-", 1);
+    return 1 + out_duration(out, abs(minutes));
+}
+
+void out_spaces(OutBuf *out, int count) {
+    for (; count > 0; count--) {
+        out_bytes(out, " ", 1);
+    }
+}
+
+// Breaks column of a day, 11 characters wide: a single break as
+// HH:MM-HH:MM, a break still running as HH:MM-??:??, or the number of
+// breaks and their total time
+void out_breaks(OutBuf *out, const WorkDay *day) {
+    int breaks = day->punch_count > 2 ? (day->punch_count - 1) / 2 : 0;
+    if (day->state == STATE_LUNCH_START) {
+        out_clock(out, day->punches[day->punch_count - 1] % MINUTES_PER_DAY);
+        out_bytes(out, "-??:??", 6);
+    } else if (breaks == 1) {
+        out_clock(out, day->punches[1] % MINUTES_PER_DAY);
+        out_bytes(out, "-", 1);
+        out_clock(out, day->punches[2] % MINUTES_PER_DAY);
+    } else if (breaks == 0) {
+        out_bytes(out, "-          ", 11);
+    } else {
+        int total = 0;
+        for (int i = 2; i < day->punch_count; i += 2) {
+            total += day->punches[i] - day->punches[i - 1];
         }
+        out_int(out, breaks);
+        out_bytes(out, "x ", 2);
+        out_spaces(out, 8 - out_duration(out, total));
     }
+}
 
-    // Shift entries if needed
-    if (count >= capacity) {
-        capacity++;
-        entries = realloc(entries, capacity * sizeof(WorkDay));
+// One table row for a completed day. With an id, the row is laid out for
+// the modify_entry() listing; without (id 0), for show_history().
+void render_day_row(OutBuf *out, const WorkDay *day, int id) {
+    if (id > 0) {
+        out_int_width(out, id, 2);
+        out_bytes(out, " | ", 3);
+    }
+    out_date(out, day->date);
+    out_bytes(out, " | ", 3);
+    out_clock(out, day->punches[0]);
+    out_bytes(out, "  | ", 4);
+    out_breaks(out, day);
+    out_bytes(out, " | ", 3);
+    out_spaces(out, 7 - out_punch(out, day->punches[day->punch_count - 1]));
+    out_bytes(out, "| ", 2);
+    out_clock(out, day->worked_minutes);
+    if (id > 0) {
+        out_bytes(out, "        | ", 10);
+    } else {
+        out_bytes(out, "           | ", 13);
+        out_clock(out, day->worked_minutes - day->excess_minutes);
+        out_bytes(out, "    | ", 6);
     }
+    out_time_diff(out, day->excess_minutes);
+    out_bytes(out, "\n", 1);
+}
 
-    for (int i = count; i > insert_pos; i--) {
-        entries[i] = entries[i-1];
+// Rows to show between "more" prompts, or 0 when output is not a terminal
+int page_rows() {
+    if (!isatty(STDOUT_FILENO) || !isatty(STDIN_FILENO)) {
+        return 0;
+    }
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 14) {
+        return ws.ws_row - 4;
     }
-    entries[insert_pos] = *day;
-    count++;
+    return 40;
+}
 
-    // Rewrite file
-    FILE *write_file = fopen(data_file_path, "wb");
-    if (write_file) {
-        fwrite(entries, sizeof(WorkDay), count, write_file);
-        fclose(write_file);
+// Pause a long table. Returns 0 if the user asked to stop listing.
+int more_prompt(OutBuf *out) {
+    out_str(out, "-- More: Enter to continue, q to stop --");
+    out_flush(out);
+    char line[8];
+    int more = read_line(line, sizeof(line)) != 0 && line[0] != 'q' && line[0] != 'Q';
+    // Erase the prompt line
+    out_str(out, "\033[A\033[2K");
+    return more;
+}
 
-        printf("\n✓ Day saved!\n");
-        printf("===========================================\n");
-        printf("Arrival:         %02d:%02d\n", day->start_hour, day->start_min);
-        printf("Lunch break:     %02d:%02d - %02d:%02d\n",
-               day->lunch_start_hour, day->lunch_start_min,
-               day->lunch_end_hour, day->lunch_end_min);
-        printf("Departure:       %02d:%02d\n", day->end_hour, day->end_min);
-        printf("-------------------------------------------\n");
-        printf("Time worked:     %02d:%02d\n", day->worked_minutes / 60, day->worked_minutes % 60);
-        printf("Required:        %02d:%02d\n", REQUIRED_HOURS, REQUIRED_MINUTES);
-        printf("Difference:      ");
-        print_time_diff(day->excess_minutes);
-        printf("\n===========================================\n");
+// Day of the week, 0 for Monday (1970-01-01 was a Thursday)
+int weekday_of(int date) {
+    int weekday = (date + 3) % 7;
+    return weekday < 0 ? weekday + 7 : weekday;
+}
 
-        delete_temp_day();
-    } else {
-        printf("Error: Unable to save data\n");
+// FNV-1a, continued from hash over more bytes
+uint32_t fnv1a(uint32_t hash, const void *data, size_t size) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ p[i]) * 16777619u;
     }
-
-    free(entries);
+    return hash;
 }
 
-void calculate_end_time(WorkDay *day) {
-    int required_minutes = REQUIRED_HOURS * 60 + REQUIRED_MINUTES;
-    int lunch_duration = time_to_minutes(day->lunch_end_hour, day->lunch_end_min) - 
-                         time_to_minutes(day->lunch_start_hour, day->lunch_start_min);
-    
-    int start_minutes = time_to_minutes(day->start_hour, day->start_min);
-    int end_minutes = start_minutes + required_minutes + lunch_duration;
-    
-    minutes_to_time(end_minutes, &day->end_hour, &day->end_min);
-    
-    printf("\n===========================================\n");
-    printf("You should finish at: %02d:%02d\n", day->end_hour, day->end_min);
-    printf("===========================================\n");
+typedef struct {
+    int from;         // first day, INT32_MIN for the default week
+    int line;         // later lines win on the same day
+    int minutes[7];
+} WeekRule;
+
+typedef struct {
+    int date;
+    int minutes;
+} DayRule;
+
+int compare_week_rules(const void *a, const void *b) {
+    const WeekRule *ra = a, *rb = b;
+    if (ra->from != rb->from) {
+        return ra->from < rb->from ? -1 : 1;
+    }
+    return ra->line - rb->line;
 }
 
-void enter_day_data() {
-    is_editing = 1;
+// A daily target: H:MM, or "-" for a day off
+int parse_target(const char *text, int *minutes) {
+    if (strcmp(text, "-") == 0) {
+        *minutes = 0;
+        return 1;
+    }
+    return parse_time(text, minutes);
+}
 
-    // Load temporary data if it exists
-    int has_temp = load_temp_day(&current_day);
+// Read the schedule file and compile it. Lines (# starts a comment):
+//   week [FROM] MON TUE WED THU FRI SAT SUN   targets from a date on
+//   holiday DATE [NAME]                       nothing required
+//   day DATE H:MM                             target of a single day
+// Without a file, every day requires REQUIRED_HOURS:REQUIRED_MINUTES.
+void load_schedule() {
+    free_schedule();
+    schedule.loaded = 1;
 
-    if (has_temp) {
-        printf("\n=== RESUMING DAY: %s ===\n", current_day.date);
-        printf("\n📌 Already recorded:\n");
+    WeekRule *weeks = NULL;
+    DayRule *days = NULL;
+    size_t week_count = 0, day_count = 0, week_capacity = 0, day_capacity = 0;
 
-        if (current_day.state >= STATE_STARTED) {
-            printf("✓ Arrival: %02d:%02d\n", current_day.start_hour, current_day.start_min);
+    FILE *file = fopen(schedule_file_path, "r");
+    char line[512];
+    int line_number = 0;
+    while (file && fgets(line, sizeof(line), file)) {
+        line_number++;
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
         }
-        if (current_day.state >= STATE_LUNCH_START) {
-            printf("✓ Lunch start: %02d:%02d\n", current_day.lunch_start_hour, current_day.lunch_start_min);
+        char *fields[10];
+        int count = 0;
+        for (char *field = strtok(line, " \t\r\n"); field && count < 10; field = strtok(NULL, " \t\r\n")) {
+            fields[count++] = field;
         }
-        if (current_day.state >= STATE_LUNCH_END) {
-            printf("✓ Lunch end: %02d:%02d\n", current_day.lunch_end_hour, current_day.lunch_end_min);
+        if (count == 0) {
+            continue;
         }
-        printf("\n");
-    } else {
-        // Initialize a new day
-        current_day = (WorkDay){0};
-        get_current_date(current_day.date);
 
-        // Check if this date already exists in completed history
-        FILE *file = fopen(data_file_path, "rb");
-        if (file) {
-            WorkDay existing;
-            while (fread(&existing, sizeof(WorkDay), 1, file) == 1) {
-                if (strcmp(existing.date, current_day.date) == 0) {
-                    fclose(file);
-                    printf("\n⚠️  An entry already exists for today (%s)!\n", current_day.date);
-                    printf("Arrival: %02d:%02d, Departure: %02d:%02d\n",
-                           existing.start_hour, existing.start_min,
-                           existing.end_hour, existing.end_min);
-                    printf("Time worked: %02d:%02d\n\n",
-                           existing.worked_minutes / 60, existing.worked_minutes % 60);
-                    printf("You cannot create a new entry for today.\n");
-                    printf("Please use option 3 (Modify entry) if you need to change it.\n");
-                    is_editing = 0;
-                    return;
-                }
+        int ok = 0;
+        if (strcmp(fields[0], "week") == 0 && (count == 8 || count == 9)) {
+            WeekRule rule = {.from = INT32_MIN, .line = line_number};
+            ok = count == 8 || parse_date(fields[1], &rule.from);
+            for (int i = 0; ok && i < 7; i++) {
+                ok = parse_target(fields[count - 7 + i], &rule.minutes[i]);
+            }
+            if (ok && week_count == week_capacity) {
+                week_capacity = week_capacity ? week_capacity * 2 : 8;
+                WeekRule *grown = realloc(weeks, week_capacity * sizeof(WeekRule));
+                ok = grown != NULL;
+                weeks = ok ? grown : weeks;
+            }
+            if (ok) {
+                weeks[week_count++] = rule;
+            }
+        } else if ((strcmp(fields[0], "holiday") == 0 && count >= 2) ||
+                   (strcmp(fields[0], "day") == 0 && count == 3)) {
+            DayRule rule = {0};
+            ok = parse_date(fields[1], &rule.date) &&
+                 (fields[0][0] == 'h' || parse_target(fields[2], &rule.minutes));
+            if (ok && day_count == day_capacity) {
+                day_capacity = day_capacity ? day_capacity * 2 : 16;
+                DayRule *grown = realloc(days, day_capacity * sizeof(DayRule));
+                ok = grown != NULL;
+                days = ok ? grown : days;
+            }
+            if (ok) {
+                days[day_count++] = rule;
             }
-            fclose(file);
         }
+        if (!ok) {
+            fprintf(stderr, "⚠️  Ignoring line %d of %s\n", line_number, schedule_file_path);
+        }
+    }
+    if (file) {
+        fclose(file);
+    }
 
-        current_day.state = STATE_NEW;
-        printf("\n=== NEW DAY: %s ===\n", current_day.date);
+    // Weekly targets that apply before the first dated rule
+    if (week_count > 0) {
+        qsort(weeks, week_count, sizeof(WeekRule), compare_week_rules);
     }
-    
-    printf("\n💡 You can press Ctrl+C at any time to save and quit\n\n");
-    
-    // Arrival time (only if not recorded yet)
-    if (current_day.state == STATE_NEW) {
-        printf("Arrival time (HH:MM): ");
-        if (scanf("%d:%d", &current_day.start_hour, &current_day.start_min) != 2) {
-            clear_input_buffer();
-            printf("Invalid format\n");
-            is_editing = 0;
-            return;
-        }
-        clear_input_buffer();
-        current_day.state = STATE_STARTED;
-        save_temp_day(&current_day);
+    for (int i = 0; i < 7; i++) {
+        schedule.before[i] = REQUIRED_HOURS * 60 + REQUIRED_MINUTES;
     }
-    
-    // Lunch start (only if not recorded yet)
-    if (current_day.state == STATE_STARTED) {
-        printf("Lunch break start (HH:MM): ");
-        if (scanf("%d:%d", &current_day.lunch_start_hour, &current_day.lunch_start_min) != 2) {
-            clear_input_buffer();
-            printf("Invalid format\n");
-            is_editing = 0;
-            return;
-        }
-        clear_input_buffer();
-        current_day.state = STATE_LUNCH_START;
-        save_temp_day(&current_day);
+    size_t next = 0;
+    while (next < week_count && weeks[next].from == INT32_MIN) {
+        memcpy(schedule.before, weeks[next++].minutes, sizeof(schedule.before));
     }
-    
-    // Lunch end (only if not recorded yet)
-    if (current_day.state == STATE_LUNCH_START) {
-        printf("Lunch break end (HH:MM): ");
-        if (scanf("%d:%d", &current_day.lunch_end_hour, &current_day.lunch_end_min) != 2) {
-            clear_input_buffer();
-            printf("Invalid format\n");
-            is_editing = 0;
-            return;
+    memcpy(schedule.after, schedule.before, sizeof(schedule.after));
+
+    // The table spans every dated rule
+    int first = INT32_MAX, last = INT32_MIN;
+    if (next < week_count) {
+        first = weeks[next].from;
+        last = weeks[week_count - 1].from;
+    }
+    for (size_t i = 0; i < day_count; i++) {
+        first = days[i].date < first ? days[i].date : first;
+        last = days[i].date > last ? days[i].date : last;
+    }
+    if (first <= last && last - first >= 200 * 366) {
+        fprintf(stderr, "Error: The dated rules of %s span more than 200 years, ignoring them\n",
+                schedule_file_path);
+    } else if (first <= last) {
+        schedule.table = malloc((last - first + 1) * sizeof(uint16_t));
+        if (!schedule.table) {
+            fprintf(stderr, "Error: Not enough memory for the dated rules of %s, ignoring them\n",
+                    schedule_file_path);
         }
-        clear_input_buffer();
-        current_day.state = STATE_LUNCH_END;
-        save_temp_day(&current_day);
-        
-        // Calculate expected end time
-        calculate_end_time(&current_day);
     }
-    
-    // Departure time (always asked if we get here)
-    if (current_day.state == STATE_LUNCH_END) {
-        printf("\nDeparture time (HH:MM): ");
-        if (scanf("%d:%d", &current_day.end_hour, &current_day.end_min) != 2) {
-            clear_input_buffer();
-            printf("Invalid format\n");
-            is_editing = 0;
-            return;
+    if (schedule.table) {
+        schedule.first = first;
+        schedule.count = last - first + 1;
+        for (int date = first; date <= last; date++) {
+            while (next < week_count && weeks[next].from <= date) {
+                memcpy(schedule.after, weeks[next++].minutes, sizeof(schedule.after));
+            }
+            schedule.table[date - first] = schedule.after[weekday_of(date)];
+        }
+        for (size_t i = 0; i < day_count; i++) {
+            schedule.table[days[i].date - first] = days[i].minutes;
         }
-        clear_input_buffer();
-        
-        // Save the completed day
-        save_completed_day(&current_day);
     }
-    
-    is_editing = 0;
+    free(weeks);
+    free(days);
+
+    uint32_t hash = fnv1a(2166136261u, schedule.before, sizeof(schedule.before));
+    hash = fnv1a(hash, schedule.after, sizeof(schedule.after));
+    hash = fnv1a(hash, &schedule.first, sizeof(schedule.first));
+    schedule.hash = fnv1a(hash, schedule.table, schedule.count * sizeof(uint16_t));
+}
+
+// Minutes of work required on a day
+int required_minutes(int date) {
+    if (!schedule.loaded) {
+        load_schedule();
+    }
+    if (date >= schedule.first && date - schedule.first < schedule.count) {
+        return schedule.table[date - schedule.first];
+    }
+    return (date < schedule.first ? schedule.before : schedule.after)[weekday_of(date)];
+}
+
+uint32_t schedule_hash() {
+    if (!schedule.loaded) {
+        load_schedule();
+    }
+    return schedule.hash;
+}
+
+// Current local time as minutes after midnight
+int current_minutes() {
+    time_t now = time(NULL);
+    struct tm *t = localtime(&now);
+    return t->tm_hour * 60 + t->tm_min;
+}
+
+// Current time in minutes from midnight of date, which keeps counting
+// past midnight for a shift that started the day before
+int minutes_since(int date) {
+    return current_minutes() + (get_current_date() - date) * MINUTES_PER_DAY;
+}
+
+// Move punch times that come before the one they follow to the next
+// day, up to MAX_MIDNIGHT_GAP after it. Returns NULL, or what is wrong.
+const char *order_punches(WorkDay *day) {
+    for (int i = 1; i < day->punch_count; i++) {
+        if (day->punches[i] < day->punches[i - 1]) {
+            day->punches[i] += MINUTES_PER_DAY;
+            int gap = day->punches[i] - day->punches[i - 1];
+            if (gap < 0) {
+                return "Punch times must follow each other";
+            }
+            if (gap > MAX_MIDNIGHT_GAP) {
+                return "A time before the previous punch is only taken as after midnight up to 12 hours "
+                       "later, write HH:MM+1 for more";
+            }
+        }
+    }
+    if (day->punch_count > 0 &&
+        (day->punches[0] >= MINUTES_PER_DAY ||
+         day->punches[day->punch_count - 1] - day->punches[0] >= MINUTES_PER_DAY)) {
+        return "A shift must start on its day and last less than 24 hours";
+    }
+    return NULL;
+}
+
+// Day computation: worked, excess and expected end minutes of a day.
+// Every caller goes through these, one day at a time, or through
+// compute_days() for many stored days at once.
+
+// Minutes worked in the closed work periods of a day
+int worked_in_periods(const WorkDay *day) {
+    int worked = 0;
+    for (int i = 1; i < day->punch_count; i += 2) {
+        worked += day->punches[i] - day->punches[i - 1];
+    }
+    return worked;
+}
+
+// Minutes spent on breaks that are over
+int break_minutes(const WorkDay *day) {
+    int breaks = 0;
+    for (int i = 2; i < day->punch_count; i += 2) {
+        breaks += day->punches[i] - day->punches[i - 1];
+    }
+    return breaks;
+}
+
+// Departure that completes the required time, in minutes after midnight
+int expected_end_minutes(const WorkDay *day) {
+    return day->punches[0] + required_minutes(day->date) + break_minutes(day);
+}
+
+// Derive worked and excess minutes from the recorded times
+void calculate_day_totals(WorkDay *day) {
+    day->worked_minutes = worked_in_periods(day);
+    day->excess_minutes = day->worked_minutes - required_minutes(day->date);
+}
+
+// Completed days side by side, one array per value (see read_days()).
+// Slots past count hold whatever the previous batch left there.
+#define DAY_BATCH 1024
+
+typedef struct {
+    size_t count;
+    int32_t date[DAY_BATCH];
+    int32_t arrival[DAY_BATCH];
+    int32_t departure[DAY_BATCH];
+    int32_t breaks[DAY_BATCH];
+    int32_t required[DAY_BATCH];
+    int32_t worked[DAY_BATCH];
+    int32_t excess[DAY_BATCH];
+    int32_t expected_end[DAY_BATCH];
+} DayBatch;
+
+// The formulas above for a whole batch. In a completed day the work
+// periods and breaks fill the time from arrival to departure, so worked
+// time needs no loop over the punches. The loop covers every slot, a
+// fixed count the compiler turns into vector code without a scalar
+// tail; the slots past count are computed and ignored.
+void compute_days(DayBatch *batch) {
+    for (size_t i = 0; i < DAY_BATCH; i++) {
+        batch->worked[i] = batch->departure[i] - batch->arrival[i] - batch->breaks[i];
+        batch->excess[i] = batch->worked[i] - batch->required[i];
+        batch->expected_end[i] = batch->arrival[i] + batch->required[i] + batch->breaks[i];
+    }
+}
+
+// Progress of a day at minutes after midnight
+typedef struct {
+    DayState state;
+    int worked;        // minutes worked so far
+    int expected_end;  // minutes after midnight, -1 until back from a break
+} DayStatus;
+
+void day_status(const WorkDay *day, int now, DayStatus *status) {
+    status->state = day->state;
+    status->expected_end = day->state >= STATE_LUNCH_END ? expected_end_minutes(day) : -1;
+    status->worked = worked_in_periods(day);
+    // An odd number of punches: the last period is still running
+    if (day->punch_count % 2 == 1 && now > day->punches[day->punch_count - 1]) {
+        status->worked += now - day->punches[day->punch_count - 1];
+    }
+}
+
+// Flush the directory holding path, so a rename or a new file in it
+// survives a crash
+int sync_parent_dir(const char *path) {
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash = strrchr(dir, '/');
+    if (!slash) {
+        return 1;
+    }
+    *slash = '\0';
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return 0;
+    }
+    int ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+// Wait for an fcntl() lock on length bytes at start (0: to the end of the
+// file, including what is appended later)
+int lock_range(int fd, short type, off_t start, off_t length) {
+    struct flock lock = {0};
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = start;
+    lock.l_len = length;
+    while (fcntl(fd, F_SETLKW, &lock) < 0) {
+        if (errno != EINTR) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Replace a file with new contents: write a sibling temp file, flush it
+// and rename it over the old one, so a crash leaves either version but
+// never a torn one. Caches can skip the flushes (durable = 0).
+int write_file_atomic(const char *path, const void *data, size_t size, int durable) {
+    // A name of its own, so that concurrent writers do not rename each
+    // other's files away
+    char tmp_path[520];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+
+    int fd = mkstemp(tmp_path);
+    if (fd < 0) {
+        return 0;
+    }
+
+    int ok = 1;
+    for (size_t done = 0; ok && done < size; ) {
+        ssize_t n = write(fd, (const char *)data + done, size - done);
+        ok = n > 0;
+        done += ok ? n : 0;
+    }
+    if (ok && durable && fsync(fd) != 0) {
+        ok = 0;
+    }
+    if (close(fd) != 0) {
+        ok = 0;
+    }
+
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return 0;
+    }
+    return !durable || sync_parent_dir(path);
+}
+
+// Status of today as of the last punch, so that status bars polling
+// every second read one small file and only add the time since then
+typedef struct {
+    char magic[4];     // "WTST"
+    int date;
+    DayStatus status;  // at the anchor time
+    int anchor;        // minutes after midnight the worked time runs from, -1 when stopped
+    uint32_t schedule; // schedule_hash() the expected end was computed with
+} StatusRecord;
+
+void status_record(const WorkDay *day, StatusRecord *record) {
+    memcpy(record->magic, "WTST", 4);
+    record->date = day->date;
+    record->schedule = schedule_hash();
+    record->anchor = -1;
+    if (day->punch_count % 2 == 1) {
+        record->anchor = day->punches[day->punch_count - 1];
+    }
+    day_status(day, record->anchor >= 0 ? record->anchor : 0, &record->status);
+}
+
+int load_status(StatusRecord *record) {
+    int fd = open(status_file_path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    int ok = read(fd, record, sizeof(*record)) == sizeof(*record) && memcmp(record->magic, "WTST", 4) == 0;
+    close(fd);
+    return ok;
+}
+
+// A cache: losing it only costs one recomputation
+void save_status(const WorkDay *day) {
+    StatusRecord record;
+    status_record(day, &record);
+    write_file_atomic(status_file_path, &record, sizeof(record), 0);
+}
+
+void invalidate_status() {
+    unlink(status_file_path);
+}
+
+// Status at now minutes after midnight
+void status_at(const StatusRecord *record, int now, DayStatus *status) {
+    *status = record->status;
+    if (record->anchor >= 0 && now > record->anchor) {
+        status->worked += now - record->anchor;
+    }
+}
+
+int load_temp_day(WorkDay *day) {
+    FILE *file = fopen(temp_file_path, "rb");
+    if (!file) {
+        return 0;
+    }
+    
+    *day = (WorkDay){0};
+    size_t size = fread(day, 1, sizeof(WorkDay), file);
+    fclose(file);
+    if (size == sizeof(FixedWorkDay)) {
+        // Saved by a version with one lunch break: one punch per state
+        FixedWorkDay fixed;
+        memcpy(&fixed, day, sizeof(fixed));
+        *day = (WorkDay){.date = fixed.date, .state = fixed.state};
+        for (int i = 0; i < 4 && i < (int)fixed.state; i++) {
+            day->punches[day->punch_count++] = time_to_minutes(fixed.times[i * 2], fixed.times[i * 2 + 1]);
+        }
+        size = sizeof(WorkDay);
+    } else if (size == sizeof(LegacyWorkDay)) {
+        // Saved by the first version, with the date as text, the way
+        // migrate_legacy_file() reads its records
+        LegacyWorkDay legacy;
+        memcpy(&legacy, day, sizeof(legacy));
+        char date[sizeof(legacy.date)];
+        memcpy(date, legacy.date, sizeof(date));
+        date[sizeof(date) - 1] = '\0';
+        *day = (WorkDay){.state = legacy.state};
+        if (!parse_date(date, &day->date)) {
+            day->date = INT32_MIN;
+        }
+        const int times[8] = {legacy.start_hour, legacy.start_min, legacy.lunch_start_hour, legacy.lunch_start_min,
+                              legacy.lunch_end_hour, legacy.lunch_end_min, legacy.end_hour, legacy.end_min};
+        for (int i = 0; i < 4 && i < (int)legacy.state; i++) {
+            day->punches[day->punch_count++] = time_to_minutes(times[i * 2], times[i * 2 + 1]);
+        }
+        size = sizeof(WorkDay);
+    }
+    
+    // Check if it's the same day, or a shift from yesterday that is
+    // still running past midnight
+    int today = get_current_date();
+    int running = day->date == today - 1 && day->punch_count > 0 &&
+                  minutes_since(day->date) - day->punches[day->punch_count - 1] <= MAX_PUNCH_GAP;
+    if (day->date != today && !running) {
+        remove(temp_file_path);
+        return 0;
+    }
+    
+    return size == sizeof(WorkDay);
+}
+
+// Returns 0 if the day in progress could not be written
+int save_temp_day(WorkDay *day) {
+    if (!write_file_atomic(temp_file_path, day, sizeof(WorkDay), 1)) {
+        return 0;
+    }
+    save_status(day);
+    return 1;
+}
+
+// Lock the day in progress against other processes from loading it until
+// it is saved, so that no punch is lost. Returns the descriptor to close
+// to unlock it, or -1.
+int lock_temp_day() {
+    int fd = open(temp_lock_file_path, O_RDWR | O_CREAT, 0600);
+    if (fd >= 0 && !lock_range(fd, F_WRLCK, 0, 0)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void delete_temp_day() {
+    remove(temp_file_path);
+    invalidate_status();
+}
+
+void signal_handler(int signum) {
+    if (signum == SIGINT && is_editing) {
+        printf("\n\n✓ Saving...\n");
+        if (!save_temp_day(&current_day)) {
+            printf("Error: Unable to save the day in progress\n");
+            exit(1);
+        }
+        printf("✓ Data saved! You can continue later.\n");
+        exit(0);
+    }
+}
+
+// Read everything from a file descriptor into a NUL-terminated buffer
+char *read_all(int fd, size_t *size) {
+    size_t capacity = 1 << 16;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        capacity = st.st_size + 1;
+    }
+
+    char *buf = malloc(capacity);
+    size_t len = 0;
+    while (buf) {
+        if (len + 1 >= capacity) {
+            capacity *= 2;
+            char *grown = realloc(buf, capacity);
+            if (!grown) {
+                break;
+            }
+            buf = grown;
+        }
+        ssize_t n = read(fd, buf + len, capacity - len - 1);
+        if (n < 0) {
+            break;
+        }
+        if (n == 0) {
+            buf[len] = '\0';
+            *size = len;
+            return buf;
+        }
+        len += n;
+    }
+    free(buf);
+    return NULL;
+}
+
+// Little-endian field access, so data files move between machines
+unsigned get_u16(const unsigned char *p) {
+    return p[0] | p[1] << 8;
+}
+
+void put_u16(unsigned char *p, unsigned value) {
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+}
+
+uint32_t get_u32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+void put_u32(unsigned char *p, uint32_t value) {
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+    p[2] = (value >> 16) & 0xFF;
+    p[3] = (value >> 24) & 0xFF;
+}
+
+int32_t get_i32(const unsigned char *p) {
+    return (int32_t)get_u32(p);
+}
+
+void put_i32(unsigned char *p, int32_t value) {
+    put_u32(p, (uint32_t)value);
+}
+
+// Pack a completed day into records (up to MAX_DAY_RECORDS). Returns how
+// many, or 0 if the day cannot be stored.
+size_t encode_day(const WorkDay *day, unsigned char *rec) {
+    if (day->punch_count < 2 || day->punch_count % 2 != 0 || day->punch_count > MAX_PUNCHES) {
+        return 0;
+    }
+    size_t records = (day->punch_count + 3) / 4;
+    for (size_t r = 0; r < records; r++) {
+        put_i32(rec + r * RECORD_SIZE, day->date);
+        for (int i = 0; i < 4; i++) {
+            int index = r * 4 + i;
+            int minutes = index < day->punch_count ? day->punches[index] : NO_PUNCH;
+            if (minutes < 0 || minutes > NO_PUNCH || (minutes == NO_PUNCH && index < day->punch_count)) {
+                return 0;
+            }
+            put_u16(rec + r * RECORD_SIZE + 4 + i * 2, minutes);
+        }
+    }
+    return records;
+}
+
+// Unpack the day starting at rec, reading no more than available records.
+// Returns how many records it takes.
+size_t decode_day(const unsigned char *rec, size_t available, WorkDay *day) {
+    day->date = get_i32(rec);
+    day->state = STATE_COMPLETED;
+    day->punch_count = 0;
+    size_t records = 0;
+    do {
+        const unsigned char *p = rec + records * RECORD_SIZE;
+        for (int i = 0; i < 4 && day->punch_count < MAX_PUNCHES; i++) {
+            unsigned minutes = get_u16(p + 4 + i * 2);
+            if (minutes != NO_PUNCH) {
+                day->punches[day->punch_count++] = minutes;
+            }
+        }
+        records++;
+    } while (records < available && get_i32(rec + records * RECORD_SIZE) == day->date);
+    calculate_day_totals(day);
+    return records;
+}
+
+// Hash of one record. The header checksum is the sum of these, so a
+// change to one record updates it without reading the others.
+uint32_t record_hash(const unsigned char *rec) {
+    uint64_t h = get_u32(rec) * 0x9E3779B97F4A7C15ull;
+    h ^= get_u32(rec + 4) * 0xC2B2AE3D27D4EB4Full;
+    h ^= get_u32(rec + 8) * 0x165667B19E3779F9ull;
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 32;
+    return (uint32_t)h;
+}
+
+uint32_t records_checksum(const unsigned char *records, size_t count) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += record_hash(records + i * RECORD_SIZE);
+    }
+    return sum;
+}
+
+int compare_records(const void *a, const void *b) {
+    int32_t da = get_i32(a), db = get_i32(b);
+    return (da > db) - (da < db);
+}
+
+void init_header(unsigned char *header) {
+    memset(header, 0, HEADER_SIZE);
+    memcpy(header, DATA_MAGIC, 4);
+    put_u16(header + 4, DATA_VERSION);
+    put_u16(header + 6, RECORD_SIZE);
+    // Tells caches of this file apart from those of a deleted one
+    put_u32(header + 12, (uint32_t)time(NULL) ^ (uint32_t)getpid() << 16);
+}
+
+// Replace the whole data file (header included) in one write. Fills in
+// the header checksum.
+int replace_data_file(unsigned char *data, size_t size) {
+    put_u32(data + 16, records_checksum(data + HEADER_SIZE, (size - HEADER_SIZE) / RECORD_SIZE));
+    return write_file_atomic(data_file_path, data, size, 1);
+}
+
+// Convert a data file written as raw WorkDay structs by older versions
+int migrate_legacy_file() {
+    int fd = open(data_file_path, O_RDONLY);
+    if (fd < 0 || !lock_range(fd, F_RDLCK, 0, 0)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size % sizeof(LegacyWorkDay) != 0) {
+        close(fd);
+        fprintf(stderr, "Error: Unrecognized data file format (%s)\n", data_file_path);
+        return 0;
+    }
+
+    size_t legacy_count = st.st_size / sizeof(LegacyWorkDay);
+    LegacyWorkDay *legacy = malloc(legacy_count * sizeof(LegacyWorkDay) + 1);
+    unsigned char *out = malloc(HEADER_SIZE + legacy_count * RECORD_SIZE);
+    if (!legacy || !out ||
+        pread(fd, legacy, st.st_size, 0) != st.st_size) {
+        close(fd);
+        free(legacy);
+        free(out);
+        return 0;
+    }
+    close(fd);
+
+    init_header(out);
+    size_t count = 0;
+    for (size_t i = 0; i < legacy_count; i++) {
+        WorkDay day = {0};
+        char date[sizeof(legacy[i].date)];
+        memcpy(date, legacy[i].date, sizeof(date));
+        date[sizeof(date) - 1] = '\0';
+        if (!parse_date(date, &day.date)) {
+            fprintf(stderr, "⚠️  Skipping unreadable entry '%s'\n", date);
+            continue;
+        }
+        day.punch_count = 4;
+        day.punches[0] = time_to_minutes(legacy[i].start_hour, legacy[i].start_min);
+        day.punches[1] = time_to_minutes(legacy[i].lunch_start_hour, legacy[i].lunch_start_min);
+        day.punches[2] = time_to_minutes(legacy[i].lunch_end_hour, legacy[i].lunch_end_min);
+        day.punches[3] = time_to_minutes(legacy[i].end_hour, legacy[i].end_min);
+        if (encode_day(&day, out + HEADER_SIZE + count * RECORD_SIZE)) {
+            count++;
+        } else {
+            fprintf(stderr, "⚠️  Skipping unreadable entry '%s'\n", date);
+        }
+    }
+    free(legacy);
+    qsort(out + HEADER_SIZE, count, RECORD_SIZE, compare_records);
+
+    int ok = replace_data_file(out, HEADER_SIZE + count * RECORD_SIZE);
+    free(out);
+    if (!ok) {
+        fprintf(stderr, "Error: Unable to convert the data file\n");
+        return 0;
+    }
+
+    fprintf(stderr, "✓ Converted %zu days to the compact data format\n", count);
+    return 1;
+}
+
+// Check that the records of a whole data file match its header checksum
+int data_intact(const unsigned char *data, size_t size) {
+    return size >= HEADER_SIZE && (size - HEADER_SIZE) % RECORD_SIZE == 0 &&
+           records_checksum(data + HEADER_SIZE, (size - HEADER_SIZE) / RECORD_SIZE) == get_u32(data + 16);
+}
+
+// Start an in-place change of the data file: copy the header and the
+// length bytes at offset that the change will overwrite into the journal
+// and flush it. Returns the journal descriptor, or -1.
+//   journal: "WTJN" | u32 length | u32 data file size | u32 offset
+//            | u32 FNV-1a of the rest | reserved | old header | old bytes
+int begin_change(int fd, const unsigned char *header, off_t size, off_t offset, off_t length) {
+    int created = 1;
+    int journal = open(journal_file_path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (journal < 0) {
+        created = 0;
+        journal = open(journal_file_path, O_RDWR);
+    }
+    if (journal < 0) {
+        return -1;
+    }
+
+    unsigned char head[JOURNAL_HEADER_SIZE] = {0};
+    memcpy(head, JOURNAL_MAGIC, 4);
+    put_u32(head + 4, length);
+    put_u32(head + 8, size);
+    put_u32(head + 12, offset);
+
+    uint32_t hash = fnv1a(2166136261u, header, HEADER_SIZE);
+    int ok = pwrite(journal, header, HEADER_SIZE, JOURNAL_HEADER_SIZE) == HEADER_SIZE;
+    char buf[256 * RECORD_SIZE];
+    for (off_t done = 0; ok && done < length; ) {
+        off_t chunk = length - done;
+        if (chunk > (off_t)sizeof(buf)) {
+            chunk = sizeof(buf);
+        }
+        ok = pread(fd, buf, chunk, offset + done) == chunk &&
+             pwrite(journal, buf, chunk, JOURNAL_HEADER_SIZE + HEADER_SIZE + done) == chunk;
+        hash = fnv1a(hash, buf, chunk);
+        done += chunk;
+    }
+    put_u32(head + 16, fnv1a(hash, head, 16));
+
+    ok = ok && pwrite(journal, head, JOURNAL_HEADER_SIZE, 0) == JOURNAL_HEADER_SIZE &&
+         ftruncate(journal, JOURNAL_HEADER_SIZE + HEADER_SIZE + length) == 0 &&
+         fdatasync(journal) == 0 && (!created || sync_parent_dir(journal_file_path));
+    if (!ok) {
+        close(journal);
+        return -1;
+    }
+    return journal;
+}
+
+// Finish a change: the new header goes last, then everything is flushed.
+// A crash before that leaves records that fail the checksum, and the
+// journal puts the old bytes back on the next open.
+int commit_change(int fd, int journal, const unsigned char *header) {
+    if (pwrite(fd, header, HEADER_SIZE, 0) != HEADER_SIZE || fdatasync(fd) != 0) {
+        return 0;
+    }
+    // No flush needed: a journal left over from a committed change is
+    // dropped by recover_journal() because the file checks out
+    return ftruncate(journal, 0) == 0;
+}
+
+// Roll back a change that a crash interrupted before it was committed
+void recover_journal() {
+    int journal = open(journal_file_path, O_RDWR);
+    if (journal < 0) {
+        return;
+    }
+    // Wait for a writer that is still busy with the change
+    int fd = open(data_file_path, O_RDWR);
+    if (fd >= 0 && !lock_range(fd, F_WRLCK, 0, 0)) {
+        close(fd);
+        fd = -1;
+    }
+
+    size_t size = 0, data_size = 0;
+    unsigned char *saved = (unsigned char *)read_all(journal, &size);
+    unsigned char *data = fd >= 0 ? (unsigned char *)read_all(fd, &data_size) : NULL;
+
+    int valid = saved && size >= JOURNAL_HEADER_SIZE + HEADER_SIZE &&
+                memcmp(saved, JOURNAL_MAGIC, 4) == 0 &&
+                size == JOURNAL_HEADER_SIZE + HEADER_SIZE + get_u32(saved + 4);
+    if (valid) {
+        uint32_t hash = fnv1a(2166136261u, saved + JOURNAL_HEADER_SIZE, size - JOURNAL_HEADER_SIZE);
+        valid = fnv1a(hash, saved, 16) == get_u32(saved + 16);
+    }
+
+    // A torn journal means the crash came before the data file was touched
+    int ok = 1;
+    if (valid && data && !data_intact(data, data_size)) {
+        uint32_t length = get_u32(saved + 4);
+        ok = pwrite(fd, saved + JOURNAL_HEADER_SIZE, HEADER_SIZE, 0) == HEADER_SIZE &&
+             pwrite(fd, saved + JOURNAL_HEADER_SIZE + HEADER_SIZE, length, get_u32(saved + 12)) == (ssize_t)length &&
+             ftruncate(fd, get_u32(saved + 8)) == 0 && fsync(fd) == 0;
+        fprintf(stderr, ok ? "⚠️  Rolled back an interrupted change to the data file\n"
+                           : "Error: Unable to roll back an interrupted change to the data file\n");
+    }
+
+    // Keep the journal until the data file is readable again
+    if ((ok && data) || !valid) {
+        ftruncate(journal, 0);
+    }
+    free(saved);
+    free(data);
+    if (fd >= 0) {
+        close(fd);
+    }
+    close(journal);
+}
+
+// Bring an older data file to the current version: version 1 gets its
+// checksum, and version 2 records are already valid one-record days
+int upgrade_data_file() {
+    int fd = open(data_file_path, O_RDWR);
+    if (fd < 0) {
+        return 0;
+    }
+    size_t size;
+    unsigned char *data = lock_range(fd, F_WRLCK, 0, 0) ? (unsigned char *)read_all(fd, &size) : NULL;
+    int ok = data && size >= HEADER_SIZE;
+    // Another process may have upgraded it while we waited
+    if (ok && get_u16(data + 4) < DATA_VERSION) {
+        size_t count = (size - HEADER_SIZE) / RECORD_SIZE;
+        unsigned char fields[16];
+        put_u16(fields, DATA_VERSION);
+        put_u16(fields + 2, RECORD_SIZE);
+        memcpy(fields + 4, data + 8, 8);
+        put_u32(fields + 12, records_checksum(data + HEADER_SIZE, count));
+        ok = ftruncate(fd, HEADER_SIZE + count * RECORD_SIZE) == 0 &&
+             pwrite(fd, fields, sizeof(fields), 4) == sizeof(fields) && fsync(fd) == 0;
+    }
+    free(data);
+    close(fd);
+    return ok;
+}
+
+// Open the data file and check its header, migrating a legacy file or
+// writing the header of a new one first. Returns -1 if it is not usable.
+int open_data_file(int flags) {
+    struct stat st;
+    if (stat(journal_file_path, &st) == 0 && st.st_size > 0) {
+        recover_journal();
+    }
+
+    int fd = open(data_file_path, flags, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+
+    unsigned char header[HEADER_SIZE];
+    ssize_t n = pread(fd, header, HEADER_SIZE, 0);
+    if (n == 0 && (flags & O_ACCMODE) != O_RDONLY) {
+        // Another writer may be creating the file too
+        if (!lock_range(fd, F_WRLCK, 0, HEADER_SIZE)) {
+            close(fd);
+            return -1;
+        }
+        n = pread(fd, header, HEADER_SIZE, 0);
+    }
+    if (n == 0) {
+        // Empty file: nothing to check, but give it a header if we can write
+        if ((flags & O_ACCMODE) != O_RDONLY) {
+            init_header(header);
+            if (pwrite(fd, header, HEADER_SIZE, 0) != HEADER_SIZE || fsync(fd) != 0 ||
+                !sync_parent_dir(data_file_path)) {
+                close(fd);
+                return -1;
+            }
+        }
+        return fd;
+    }
+
+    if (n == HEADER_SIZE && memcmp(header, DATA_MAGIC, 4) == 0) {
+        if (get_u16(header + 4) == DATA_VERSION && get_u16(header + 6) == RECORD_SIZE) {
+            return fd;
+        }
+        close(fd);
+        if (get_u16(header + 4) < DATA_VERSION && get_u16(header + 6) == RECORD_SIZE) {
+            if (!upgrade_data_file()) {
+                fprintf(stderr, "Error: Unable to upgrade the data file\n");
+                return -1;
+            }
+            return open_data_file(flags);
+        }
+        fprintf(stderr, "Error: Unsupported data file version %u\n", get_u16(header + 4));
+        return -1;
+    }
+
+    close(fd);
+    if (!migrate_legacy_file()) {
+        return -1;
+    }
+    return open_data_file(flags);
+}
+
+// Open and lock the data file: readers share a lock on the whole file,
+// writers lock the header (every change rewrites it) for length bytes,
+// then the records they touch. If the file was replaced while we
+// waited, the lock is on the old one, so open the new one.
+int open_locked_data_file(int flags, short type, off_t length) {
+    for (int attempt = 0; attempt < 100; attempt++) {
+        int fd = open_data_file(flags);
+        if (fd < 0) {
+            return -1;
+        }
+        if (!lock_range(fd, type, 0, length)) {
+            close(fd);
+            return -1;
+        }
+
+        struct stat held, current;
+        if (fstat(fd, &held) == 0 && stat(data_file_path, &current) == 0 &&
+            held.st_ino == current.st_ino && held.st_dev == current.st_dev) {
+            return fd;
+        }
+        close(fd);
+    }
+    return -1;
+}
+
+// Map an open data file read-only
+int map_data_view(int fd, DataView *view) {
+    *view = (DataView){.fd = -1};
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return 0;
+    }
+
+    if (st.st_size >= HEADER_SIZE) {
+        unsigned char fields[12];
+        if (pread(fd, fields, sizeof(fields), 8) == sizeof(fields)) {
+            view->generation = get_u32(fields);
+            view->file_id = get_u32(fields + 4);
+            view->checksum = get_u32(fields + 8);
+        }
+        view->count = (st.st_size - HEADER_SIZE) / RECORD_SIZE;
+    }
+    if (view->count > 0) {
+        view->size = HEADER_SIZE + view->count * RECORD_SIZE;
+        void *map = mmap(NULL, view->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            *view = (DataView){.fd = -1};
+            return 0;
+        }
+        view->map = map;
+        view->records = (const unsigned char *)map + HEADER_SIZE;
+    }
+    return 1;
+}
+
+void close_data_view(DataView *view) {
+    if (view->map) {
+        munmap(view->map, view->size);
+    }
+    if (view->fd >= 0) {
+        close(view->fd);
+    }
+    *view = (DataView){.fd = -1};
+}
+
+// Map the data file read-only and verify its checksum. Writers block
+// until the view is closed, and with exclusive set so do readers, for
+// callers that replace the whole file. Returns 0 if there is no data
+// file or it is damaged.
+int lock_data_view(DataView *view, int exclusive) {
+    int fd = exclusive ? open_locked_data_file(O_RDWR | O_CREAT, F_WRLCK, 0)
+                       : open_locked_data_file(O_RDONLY, F_RDLCK, 0);
+    if (fd < 0) {
+        *view = (DataView){.fd = -1};
+        return 0;
+    }
+
+    int ok = map_data_view(fd, view);
+    if (!ok) {
+        close(fd);
+        return 0;
+    }
+    view->fd = fd;
+    if (view->map) {
+        madvise(view->map, view->size, MADV_SEQUENTIAL);
+    }
+    if (records_checksum(view->records, view->count) != view->checksum) {
+        fprintf(stderr, "Error: The data file is damaged (checksum mismatch): %s\n", data_file_path);
+        close_data_view(view);
+        return 0;
+    }
+    return 1;
+}
+
+int open_data_view(DataView *view) {
+    return lock_data_view(view, 0);
+}
+
+// Open the history for a command that writes it out. No data file is an
+// empty history; any other failure is reported on stderr, away from the
+// output. Returns 0 on failure.
+int open_history(DataView *view) {
+    if (open_data_view(view)) {
+        return 1;
+    }
+    struct stat st;
+    if (stat(data_file_path, &st) != 0 && errno == ENOENT) {
+        return 1;
+    }
+    fprintf(stderr, "Error: Unable to read the history in %s\n", data_file_path);
+    return 0;
+}
+
+int record_date(const DataView *view, size_t index) {
+    return get_i32(view->records + index * RECORD_SIZE);
+}
+
+// Read the day whose first record is at index. Returns how many records
+// it takes, so a loop over the days steps by that.
+size_t read_day(const DataView *view, size_t index, WorkDay *day) {
+    return decode_day(view->records + index * RECORD_SIZE, view->count - index, day);
+}
+
+// Read the days whose records are at index..end (end at a day boundary)
+// into a batch, up to DAY_BATCH of them, with their required minutes.
+// Returns how many records were read.
+size_t read_days(const DataView *view, size_t index, size_t end, DayBatch *batch) {
+    size_t i = index;
+    size_t n = 0;
+    while (i < end && n < DAY_BATCH) {
+        int32_t date = record_date(view, i);
+        int punches = 0, last = 0, breaks = 0;
+        do {
+            const unsigned char *rec = view->records + i * RECORD_SIZE;
+            for (int k = 0; k < 4; k++) {
+                unsigned minutes = get_u16(rec + 4 + k * 2);
+                if (minutes == NO_PUNCH) {
+                    continue;
+                }
+                if (punches == 0) {
+                    batch->arrival[n] = minutes;
+                } else if (punches % 2 == 0) {
+                    breaks += minutes - last;
+                }
+                last = minutes;
+                punches++;
+            }
+            i++;
+        } while (i < end && record_date(view, i) == date);
+        batch->date[n] = date;
+        batch->departure[n] = last;
+        batch->breaks[n] = breaks;
+        batch->required[n] = required_minutes(date);
+        n++;
+    }
+    batch->count = n;
+    return i - index;
+}
+
+// Find where a date is, or where it would go, in the sorted records.
+// Sets *found when the record at the returned index has that date.
+size_t find_day(const DataView *view, int date, int *found) {
+    size_t lo = 0, hi = view->count;
+
+    // New days are nearly always after the last one
+    if (hi > 0 && record_date(view, hi - 1) < date) {
+        *found = 0;
+        return hi;
+    }
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (record_date(view, mid) < date) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    *found = lo < view->count && record_date(view, lo) == date;
+    return lo;
+}
+
+// Month index (year * 12 + month - 1) of a day number
+int month_of(int date) {
+    int year, month, mday;
+    civil_from_days(date, &year, &month, &mday);
+    return year * 12 + month - 1;
+}
+
+// Totals of a month, added in order if the summary has none yet.
+// Returns NULL if out of memory.
+MonthTotals *summary_month(Summary *summary, int month) {
+    size_t lo = 0, hi = summary->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (summary->months[mid].month < month) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == summary->count || summary->months[lo].month != month) {
+        if (summary->count == summary->capacity) {
+            size_t capacity = summary->capacity ? summary->capacity * 2 : 64;
+            MonthTotals *grown = realloc(summary->months, capacity * sizeof(MonthTotals));
+            if (!grown) {
+                return NULL;
+            }
+            summary->months = grown;
+            summary->capacity = capacity;
+        }
+        memmove(&summary->months[lo + 1], &summary->months[lo], (summary->count - lo) * sizeof(MonthTotals));
+        summary->months[lo] = (MonthTotals){.month = month};
+        summary->count++;
+    }
+    return &summary->months[lo];
+}
+
+// Add (sign 1) or remove (sign -1) a day from the totals. A month
+// without days is dropped.
+void summary_add(Summary *summary, const WorkDay *day, int sign) {
+    MonthTotals *totals = summary_month(summary, month_of(day->date));
+    if (!totals) {
+        return;
+    }
+
+    totals->days += sign;
+    totals->worked += sign * day->worked_minutes;
+    totals->excess += sign * day->excess_minutes;
+    summary->days += sign;
+    summary->worked += sign * day->worked_minutes;
+    summary->excess += sign * day->excess_minutes;
+
+    if (totals->days == 0) {
+        size_t index = totals - summary->months;
+        memmove(totals, totals + 1, (summary->count - index - 1) * sizeof(MonthTotals));
+        summary->count--;
+    }
+}
+
+void free_summary(Summary *summary) {
+    free(summary->months);
+    *summary = (Summary){0};
+}
+
+// Add the days whose records are at first..last to the totals. Returns
+// how many, or -1 if out of memory.
+long summary_add_days(Summary *summary, const DataView *view, size_t first, size_t last) {
+    // Days come in date order, so a month is looked up once
+    DayBatch batch = {0};
+    MonthTotals *totals = NULL;
+    int month_end = INT32_MIN;
+    long days = 0;
+    size_t i = first;
+    while (i < last) {
+        i += read_days(view, i, last, &batch);
+        compute_days(&batch);
+        days += batch.count;
+        for (size_t k = 0; k < batch.count; k++) {
+            if (!totals || batch.date[k] >= month_end) {
+                int year, month, mday;
+                civil_from_days(batch.date[k], &year, &month, &mday);
+                totals = summary_month(summary, year * 12 + month - 1);
+                if (!totals) {
+                    return -1;
+                }
+                month_end = month == 12 ? days_from_civil(year + 1, 1, 1) : days_from_civil(year, month + 1, 1);
+            }
+            totals->days++;
+            totals->worked += batch.worked[k];
+            totals->excess += batch.excess[k];
+            summary->days++;
+            summary->worked += batch.worked[k];
+            summary->excess += batch.excess[k];
+        }
+    }
+    return days;
+}
+
+// Recompute the summary from every record of the data file
+void build_summary(Summary *summary, const DataView *view) {
+    free_summary(summary);
+    summary->generation = view->generation;
+    summary->file_id = view->file_id;
+    summary_add_days(summary, view, 0, view->count);
+}
+
+// Load the cached summary if it belongs to this generation of the file
+// and, unless any_schedule is set, to the current schedule.
+//   header: "WTSM" | u16 version | u16 month size | u32 generation
+//           | u32 data file id | u32 schedule_hash()
+//   month:  i32 month index | i32 days | i32 worked | i32 excess minutes
+int read_summary(Summary *summary, uint32_t generation, uint32_t file_id, int any_schedule) {
+    *summary = (Summary){0};
+
+    int fd = open(summary_file_path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    size_t size;
+    unsigned char *data = (unsigned char *)read_all(fd, &size);
+    close(fd);
+    if (!data) {
+        return 0;
+    }
+
+    int ok = size >= SUMMARY_HEADER_SIZE && memcmp(data, SUMMARY_MAGIC, 4) == 0 &&
+             get_u16(data + 4) == SUMMARY_VERSION && get_u16(data + 6) == SUMMARY_MONTH_SIZE &&
+             get_u32(data + 8) == generation && get_u32(data + 12) == file_id &&
+             (any_schedule || get_u32(data + 16) == schedule_hash()) &&
+             (size - SUMMARY_HEADER_SIZE) % SUMMARY_MONTH_SIZE == 0;
+    size_t count = ok ? (size - SUMMARY_HEADER_SIZE) / SUMMARY_MONTH_SIZE : 0;
+    if (ok && count > 0) {
+        summary->months = malloc(count * sizeof(MonthTotals));
+        ok = summary->months != NULL;
+    }
+
+    for (size_t i = 0; ok && i < count; i++) {
+        const unsigned char *p = data + SUMMARY_HEADER_SIZE + i * SUMMARY_MONTH_SIZE;
+        MonthTotals *totals = &summary->months[i];
+        totals->month = get_i32(p);
+        totals->days = get_i32(p + 4);
+        totals->worked = get_i32(p + 8);
+        totals->excess = get_i32(p + 12);
+        summary->days += totals->days;
+        summary->worked += totals->worked;
+        summary->excess += totals->excess;
+    }
+    free(data);
+
+    if (!ok) {
+        free_summary(summary);
+        return 0;
+    }
+    summary->count = count;
+    summary->capacity = count;
+    summary->generation = generation;
+    summary->file_id = file_id;
+    return 1;
+}
+
+int load_summary(Summary *summary, uint32_t generation, uint32_t file_id) {
+    return read_summary(summary, generation, file_id, 0);
+}
+
+int save_summary(const Summary *summary) {
+    size_t size = SUMMARY_HEADER_SIZE + summary->count * SUMMARY_MONTH_SIZE;
+    unsigned char *data = calloc(1, size);
+    if (!data) {
+        return 0;
+    }
+
+    memcpy(data, SUMMARY_MAGIC, 4);
+    put_u16(data + 4, SUMMARY_VERSION);
+    put_u16(data + 6, SUMMARY_MONTH_SIZE);
+    put_u32(data + 8, summary->generation);
+    put_u32(data + 12, summary->file_id);
+    put_u32(data + 16, schedule_hash());
+    for (size_t i = 0; i < summary->count; i++) {
+        unsigned char *p = data + SUMMARY_HEADER_SIZE + i * SUMMARY_MONTH_SIZE;
+        put_i32(p, summary->months[i].month);
+        put_i32(p + 4, summary->months[i].days);
+        put_i32(p + 8, summary->months[i].worked);
+        put_i32(p + 12, summary->months[i].excess);
+    }
+
+    // A cache: it is rebuilt if lost, so it is not flushed
+    int ok = write_file_atomic(summary_file_path, data, size, 0);
+    free(data);
+    return ok;
+}
+
+// Totals for the history, from the cache when it is current
+void get_summary(Summary *summary, const DataView *view) {
+    if (!load_summary(summary, view->generation, view->file_id)) {
+        build_summary(summary, view);
+        save_summary(summary);
+    }
+}
+
+// Recompute and save the cache after a change that touched many days
+void rebuild_summary() {
+    Summary summary = {0};
+    DataView view;
+    open_data_view(&view);
+    build_summary(&summary, &view);
+    close_data_view(&view);
+    save_summary(&summary);
+    free_summary(&summary);
+}
+
+// Bring the cache in line after one day changed, by the writer that
+// still holds fd locked. Each change bumps the data file generation by
+// one, so a cache that does not hold the previous generation missed an
+// update and is rebuilt, from fd: opening and closing the file again
+// would drop the writer's locks.
+void update_summary(int fd, uint32_t generation, uint32_t file_id, const WorkDay *removed, const WorkDay *added) {
+    Summary summary = {0};
+    if (load_summary(&summary, generation - 1, file_id)) {
+        if (removed) {
+            summary_add(&summary, removed, -1);
+        }
+        if (added) {
+            summary_add(&summary, added, 1);
+        }
+        summary.generation = generation;
+        save_summary(&summary);
+    } else {
+        DataView view;
+        if (map_data_view(fd, &view)) {
+            build_summary(&summary, &view);
+            close_data_view(&view);
+            save_summary(&summary);
+        }
+    }
+    free_summary(&summary);
+}
+
+// Write a change of one day into out as a log entry. Returns its size.
+size_t encode_log_entry(unsigned char *out, LogKind kind, int flags, uint32_t when, int date,
+                        const unsigned char *before, size_t before_records,
+                        const unsigned char *after, size_t after_records) {
+    size_t size = LOG_ENTRY_HEADER_SIZE + (before_records + after_records) * RECORD_SIZE + 2;
+    put_u32(out, when);
+    put_i32(out + 4, date);
+    out[8] = kind;
+    out[9] = flags;
+    out[10] = before_records;
+    out[11] = after_records;
+    if (before_records) {
+        memcpy(out + LOG_ENTRY_HEADER_SIZE, before, before_records * RECORD_SIZE);
+    }
+    if (after_records) {
+        memcpy(out + LOG_ENTRY_HEADER_SIZE + before_records * RECORD_SIZE, after, after_records * RECORD_SIZE);
+    }
+    put_u16(out + size - 2, size);
+    return size;
+}
+
+// Append entries to the change log after its cursor, dropping the
+// changes that were undone, and flush it. Called with the data file
+// locked, so the log is in the order of the changes.
+int append_log(const unsigned char *entries, size_t size) {
+    int fd = open(log_file_path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        printf("⚠️  Unable to record the change in %s\n", log_file_path);
+        return 0;
+    }
+
+    unsigned char header[LOG_HEADER_SIZE];
+    ssize_t n = pread(fd, header, LOG_HEADER_SIZE, 0);
+    uint32_t cursor = LOG_HEADER_SIZE;
+    if (n == LOG_HEADER_SIZE && memcmp(header, LOG_MAGIC, 4) == 0 && get_u16(header + 4) == LOG_VERSION) {
+        cursor = get_u32(header + 8);
+    } else if (n != 0) {
+        close(fd);
+        printf("⚠️  Unable to record the change in %s (unrecognized file)\n", log_file_path);
+        return 0;
+    } else {
+        memset(header, 0, LOG_HEADER_SIZE);
+        memcpy(header, LOG_MAGIC, 4);
+        put_u16(header + 4, LOG_VERSION);
+    }
+
+    // The entries go first: until the header moves the cursor past them,
+    // they are only changes that can be redone
+    put_u32(header + 8, cursor + size);
+    int ok = pwrite(fd, entries, size, cursor) == (ssize_t)size && ftruncate(fd, cursor + size) == 0 &&
+             pwrite(fd, header, LOG_HEADER_SIZE, 0) == LOG_HEADER_SIZE && fdatasync(fd) == 0;
+    if (close(fd) < 0 || !ok) {
+        printf("⚠️  Unable to record the change in %s\n", log_file_path);
+        return 0;
+    }
+    return 1;
+}
+
+// Log a change of one day, as a group of its own
+void log_day_change(int date, const unsigned char *before, size_t before_records,
+                    const unsigned char *after, size_t after_records) {
+    unsigned char entry[LOG_ENTRY_MAX];
+    if (before_records > MAX_DAY_RECORDS || after_records > MAX_DAY_RECORDS) {
+        return;
+    }
+    append_log(entry, encode_log_entry(entry, LOG_DAY, LOG_GROUP_START, (uint32_t)time(NULL), date,
+                                       before, before_records, after, after_records));
+}
+
+// Recompute the cached totals of every month from the records. A range
+// would not help: the cache is stamped with one schedule, so after a
+// change every month is out of date, and before one none is. The records
+// are read in one pass under a shared lock, so no change slips in, and
+// the cache is replaced in one write. Returns the days recomputed, or -1.
+// *before and *after get the total excess (before is only set if there
+// was a cache, computed with any schedule).
+long recompute_summary(int *had_cache, long long *before, long long *after) {
+    DataView view;
+    if (!open_data_view(&view)) {
+        return -1;
+    }
+
+    Summary old, summary = {.generation = view.generation, .file_id = view.file_id};
+    *had_cache = read_summary(&old, view.generation, view.file_id, 1);
+    *before = old.excess;
+    free_summary(&old);
+
+    long days = summary_add_days(&summary, &view, 0, view.count);
+    if (days >= 0 && !save_summary(&summary)) {
+        days = -1;
+    }
+    close_data_view(&view);
+    *after = summary.excess;
+    free_summary(&summary);
+    return days;
+}
+
+// Move the records from..end of the data file by shift bytes, copying
+// in the order that never overwrites a record before it is moved
+int move_records(int fd, off_t from, off_t end, off_t shift) {
+    char buf[256 * RECORD_SIZE];
+    for (off_t done = 0; done < end - from; ) {
+        off_t chunk = end - from - done;
+        if (chunk > (off_t)sizeof(buf)) {
+            chunk = sizeof(buf);
+        }
+        off_t at = shift > 0 ? end - done - chunk : from + done;
+        if (pread(fd, buf, chunk, at) != chunk || pwrite(fd, buf, chunk, at + shift) != chunk) {
+            return 0;
+        }
+        done += chunk;
+    }
+    return 1;
+}
+
+// Write a completed day into the data file without rewriting the history.
+// The file is kept in chronological order, so a punch for today is an
+// append (or an in-place patch of the last records); only an older date
+// that is not in the file yet, or a day that changes its number of
+// records, needs to shift the records after it.
+int store_day(const WorkDay *day) {
+    unsigned char rec[MAX_DAY_RECORDS * RECORD_SIZE];
+    size_t records = encode_day(day, rec);
+    if (!records) {
+        return 0;
+    }
+
+    int fd = open_locked_data_file(O_RDWR | O_CREAT, F_WRLCK, HEADER_SIZE);
+    if (fd < 0) {
+        return 0;
+    }
+
+    unsigned char header[HEADER_SIZE];
+    DataView view;
+    if (pread(fd, header, HEADER_SIZE, 0) != HEADER_SIZE || !map_data_view(fd, &view)) {
+        close(fd);
+        return 0;
+    }
+
+    off_t count = view.count;
+    int replace;
+    off_t pos = find_day(&view, day->date, &replace);
+    uint32_t checksum = get_u32(header + 16) + records_checksum(rec, records);
+    WorkDay old, added;
+    unsigned char old_rec[MAX_DAY_RECORDS * RECORD_SIZE];
+    size_t old_records = 0;
+    if (replace) {
+        old_records = read_day(&view, pos, &old);
+        checksum -= records_checksum(view.records + pos * RECORD_SIZE, old_records);
+        if (old_records <= MAX_DAY_RECORDS) {
+            memcpy(old_rec, view.records + pos * RECORD_SIZE, old_records * RECORD_SIZE);
+        }
+    }
+    decode_day(rec, records, &added);
+    close_data_view(&view);
+
+    // The journal keeps the records being patched, or the tail that moves
+    off_t start = HEADER_SIZE + pos * RECORD_SIZE;
+    off_t end = HEADER_SIZE + count * RECORD_SIZE;
+    off_t shift = ((off_t)records - (off_t)old_records) * RECORD_SIZE;
+    if (!lock_range(fd, F_WRLCK, start, shift == 0 ? (off_t)records * RECORD_SIZE : 0)) {
+        close(fd);
+        return 0;
+    }
+    int journal = begin_change(fd, header, end, start, shift == 0 ? (off_t)old_records * RECORD_SIZE : end - start);
+    if (journal < 0) {
+        close(fd);
+        return 0;
+    }
+
+    int ok = shift == 0 || move_records(fd, start + old_records * RECORD_SIZE, end, shift);
+
+    uint32_t generation = get_u32(header + 8) + 1;
+    put_u32(header + 8, generation);
+    put_u32(header + 16, checksum);
+    ok = ok && pwrite(fd, rec, records * RECORD_SIZE, start) == (ssize_t)(records * RECORD_SIZE) &&
+         (shift >= 0 || ftruncate(fd, end + shift) == 0) && commit_change(fd, journal, header);
+    close(journal);
+    // Still under the lock, so caches are updated in generation order
+    if (ok) {
+        log_day_change(day->date, old_rec, old_records, rec, records);
+        update_summary(fd, generation, get_u32(header + 12), replace ? &old : NULL, &added);
+        if (added.date == get_current_date()) {
+            invalidate_status();
+        }
+    }
+    if (close(fd) < 0) {
+        ok = 0;
+    }
+    return ok;
+}
+
+// Remove the records of a date by shifting the tail to the left
+int delete_day(int date) {
+    int fd = open_locked_data_file(O_RDWR, F_WRLCK, HEADER_SIZE);
+    if (fd < 0) {
+        return 0;
+    }
+
+    unsigned char header[HEADER_SIZE];
+    DataView view;
+    if (pread(fd, header, HEADER_SIZE, 0) != HEADER_SIZE || !map_data_view(fd, &view)) {
+        close(fd);
+        return 0;
+    }
+
+    // Look the date up under the lock: the index shown to the user may
+    // have moved since
+    int found;
+    off_t count = view.count;
+    off_t index = find_day(&view, date, &found);
+    WorkDay removed;
+    unsigned char old_rec[MAX_DAY_RECORDS * RECORD_SIZE];
+    size_t records = 0;
+    uint32_t checksum = 0;
+    if (found) {
+        records = read_day(&view, index, &removed);
+        checksum = records_checksum(view.records + index * RECORD_SIZE, records);
+        if (records <= MAX_DAY_RECORDS) {
+            memcpy(old_rec, view.records + index * RECORD_SIZE, records * RECORD_SIZE);
+        }
+    }
+    close_data_view(&view);
+    if (!found) {
+        close(fd);
+        return 0;
+    }
+
+    off_t start = HEADER_SIZE + index * RECORD_SIZE;
+    off_t end = HEADER_SIZE + count * RECORD_SIZE;
+    off_t length = records * RECORD_SIZE;
+    if (!lock_range(fd, F_WRLCK, start, 0)) {
+        close(fd);
+        return 0;
+    }
+    int journal = begin_change(fd, header, end, start, end - start);
+    if (journal < 0) {
+        close(fd);
+        return 0;
+    }
+
+    int ok = move_records(fd, start + length, end, -length);
+
+    uint32_t generation = get_u32(header + 8) + 1;
+    put_u32(header + 8, generation);
+    put_u32(header + 16, get_u32(header + 16) - checksum);
+    ok = ok && ftruncate(fd, end - length) == 0 && commit_change(fd, journal, header);
+    close(journal);
+    if (ok) {
+        log_day_change(date, old_rec, records, NULL, 0);
+        update_summary(fd, generation, get_u32(header + 12), &removed, NULL);
+        if (removed.date == get_current_date()) {
+            invalidate_status();
+        }
+    }
+    if (close(fd) < 0) {
+        ok = 0;
+    }
+    return ok;
+}
+
+// Log the removal of every day of a data file, as one group
+int log_all_deleted(const DataView *view) {
+    if (view->count == 0) {
+        return 1;
+    }
+    unsigned char *entries = malloc(view->count * (LOG_ENTRY_HEADER_SIZE + RECORD_SIZE + 2));
+    if (!entries) {
+        return 0;
+    }
+    uint32_t now = (uint32_t)time(NULL);
+    size_t size = 0, i = 0;
+    while (i < view->count) {
+        int date = record_date(view, i);
+        size_t j = i + 1;
+        while (j < view->count && record_date(view, j) == date) {
+            j++;
+        }
+        if (j - i <= MAX_DAY_RECORDS) {
+            size += encode_log_entry(entries + size, LOG_RESET, size == 0 ? LOG_GROUP_START : 0, now, date,
+                                     view->records + i * RECORD_SIZE, j - i, NULL, 0);
+        }
+        i = j;
+    }
+    int ok = append_log(entries, size);
+    free(entries);
+    return ok;
+}
+
+// One change read back from the log
+typedef struct {
+    size_t offset;
+    size_t size;
+    uint32_t time;
+    int date;
+    LogKind kind;
+    int flags;
+    const unsigned char *before;
+    size_t before_records;
+    const unsigned char *after;
+    size_t after_records;
+} LogEntry;
+
+// The change log read into memory
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    size_t cursor;
+} ChangeLog;
+
+// Read the change log; a missing one reads as empty. Returns 0 if it is
+// not usable (reported).
+int load_log(ChangeLog *log) {
+    *log = (ChangeLog){.size = LOG_HEADER_SIZE, .cursor = LOG_HEADER_SIZE};
+    int fd = open(log_file_path, O_RDONLY);
+    if (fd < 0) {
+        return errno == ENOENT;
+    }
+    size_t size;
+    unsigned char *data = (unsigned char *)read_all(fd, &size);
+    close(fd);
+    if (data && size == 0) {
+        free(data);
+        return 1;
+    }
+    if (!data || size < LOG_HEADER_SIZE || memcmp(data, LOG_MAGIC, 4) != 0 ||
+        get_u16(data + 4) != LOG_VERSION || get_u32(data + 8) < LOG_HEADER_SIZE || get_u32(data + 8) > size) {
+        printf("Error: Unrecognized change log: %s\n", log_file_path);
+        free(data);
+        return 0;
+    }
+    log->data = data;
+    log->size = size;
+    log->cursor = get_u32(data + 8);
+    return 1;
+}
+
+// Parse the entry at offset. Returns 0 if it is damaged.
+int log_entry_at(const ChangeLog *log, size_t offset, LogEntry *entry) {
+    if (offset < LOG_HEADER_SIZE || offset + LOG_ENTRY_HEADER_SIZE + 2 > log->size) {
+        return 0;
+    }
+    const unsigned char *p = log->data + offset;
+    entry->offset = offset;
+    entry->time = get_u32(p);
+    entry->date = get_i32(p + 4);
+    entry->kind = p[8];
+    entry->flags = p[9];
+    entry->before_records = p[10];
+    entry->after_records = p[11];
+    entry->before = p + LOG_ENTRY_HEADER_SIZE;
+    entry->after = entry->before + entry->before_records * RECORD_SIZE;
+    entry->size = LOG_ENTRY_HEADER_SIZE + (entry->before_records + entry->after_records) * RECORD_SIZE + 2;
+    return offset + entry->size <= log->size && get_u16(p + entry->size - 2) == entry->size;
+}
+
+// Parse the entry that ends at end
+int log_entry_before(const ChangeLog *log, size_t end, LogEntry *entry) {
+    if (end < LOG_HEADER_SIZE + 2 || end > log->size) {
+        return 0;
+    }
+    size_t size = get_u16(log->data + end - 2);
+    return size <= end && log_entry_at(log, end - size, entry) && entry->size == size;
+}
+
+// Start of the group of changes that ends at end, or -1 if the log is
+// damaged
+long log_group_start(const ChangeLog *log, size_t end) {
+    LogEntry entry;
+    do {
+        if (!log_entry_before(log, end, &entry)) {
+            return -1;
+        }
+        end = entry.offset;
+    } while (!(entry.flags & LOG_GROUP_START));
+    return end;
+}
+
+// End of the group of changes that starts at start, or -1
+long log_group_end(const ChangeLog *log, size_t start) {
+    LogEntry entry;
+    do {
+        if (!log_entry_at(log, start, &entry)) {
+            return -1;
+        }
+        start += entry.size;
+    } while (start + LOG_ENTRY_HEADER_SIZE <= log->size && !(log->data[start + 9] & LOG_GROUP_START));
+    return start;
+}
+
+int compare_log_entries(const void *a, const void *b) {
+    const LogEntry *ea = a, *eb = b;
+    if (ea->date != eb->date) {
+        return (ea->date > eb->date) - (ea->date < eb->date);
+    }
+    return (ea->offset > eb->offset) - (ea->offset < eb->offset);
+}
+
+// Bring the data file to the state of the log with its cursor at target,
+// a group boundary: undo the changes between target and the cursor, or
+// redo the ones between the cursor and target, in one rewrite of the
+// file. Each day they touch must still be as the log left it. view is
+// the data file, locked exclusively. Returns the days changed, or -1
+// (reported).
+long replay_log(const ChangeLog *log, const DataView *view, size_t target) {
+    int undo = target < log->cursor;
+    size_t lo = undo ? target : log->cursor;
+    size_t hi = undo ? log->cursor : target;
+
+    LogEntry *entries = malloc(((hi - lo) / (LOG_ENTRY_HEADER_SIZE + 2) + 1) * sizeof(LogEntry));
+    if (!entries) {
+        printf("Error: Out of memory\n");
+        return -1;
+    }
+    size_t count = 0, records = view->count;
+    for (size_t at = lo; at < hi; at += entries[count++].size) {
+        if (!log_entry_at(log, at, &entries[count])) {
+            printf("Error: The change log is damaged: %s\n", log_file_path);
+            free(entries);
+            return -1;
+        }
+        records += entries[count].before_records + entries[count].after_records;
+    }
+    if (count > 0) {
+        qsort(entries, count, sizeof(LogEntry), compare_log_entries);
+    }
+
+    unsigned char *out = malloc(HEADER_SIZE + records * RECORD_SIZE);
+    if (!out) {
+        free(entries);
+        printf("Error: Out of memory\n");
+        return -1;
+    }
+    init_header(out);
+    if (view->generation || view->file_id) {
+        put_u32(out + 8, view->generation + 1);
+        put_u32(out + 12, view->file_id);
+    }
+
+    // Merge the days the entries touch into the records, in date order
+    unsigned char *dst = out + HEADER_SIZE;
+    size_t i = 0;
+    long days = 0;
+    for (size_t k = 0; k < count; days++) {
+        size_t last = k;
+        while (last + 1 < count && entries[last + 1].date == entries[k].date) {
+            last++;
+        }
+        // Undoing, the day must be as the latest change left it and goes
+        // back to before the earliest; redoing, the other way round
+        const LogEntry *first_entry = &entries[k], *last_entry = &entries[last];
+        const unsigned char *now = undo ? last_entry->after : first_entry->before;
+        size_t now_records = undo ? last_entry->after_records : first_entry->before_records;
+        const unsigned char *next = undo ? first_entry->before : last_entry->after;
+        size_t next_records = undo ? first_entry->before_records : last_entry->after_records;
+        int date = entries[k].date;
+        k = last + 1;
+
+        while (i < view->count && record_date(view, i) < date) {
+            memcpy(dst, view->records + i * RECORD_SIZE, RECORD_SIZE);
+            dst += RECORD_SIZE;
+            i++;
+        }
+        size_t j = i;
+        while (j < view->count && record_date(view, j) == date) {
+            j++;
+        }
+        // An empty data file or a day with no records has no pointer to compare
+        if (j - i != now_records ||
+            (now_records > 0 && memcmp(view->records + i * RECORD_SIZE, now, now_records * RECORD_SIZE) != 0)) {
+            char text[11];
+            format_date(date, text);
+            printf("Error: %s was changed outside the change log, nothing %s\n", text, undo ? "undone" : "redone");
+            free(entries);
+            free(out);
+            return -1;
+        }
+        if (next_records > 0) {
+            memcpy(dst, next, next_records * RECORD_SIZE);
+            dst += next_records * RECORD_SIZE;
+        }
+        i = j;
+    }
+    free(entries);
+    if (i < view->count) {
+        memcpy(dst, view->records + i * RECORD_SIZE, (view->count - i) * RECORD_SIZE);
+        dst += (view->count - i) * RECORD_SIZE;
+    }
+
+    int ok = replace_data_file(out, dst - out);
+    free(out);
+    if (!ok) {
+        printf("Error: Unable to save data\n");
+        return -1;
+    }
+    return days;
+}
+
+int save_log_cursor(size_t cursor) {
+    unsigned char fields[8];
+    int fd = open(log_file_path, O_RDWR);
+    int ok = fd >= 0 && pread(fd, fields, sizeof(fields), 8) == sizeof(fields);
+    put_u32(fields, cursor);
+    // Changes undone past the last snapshot are no longer in the log
+    // after it, so the next snapshot cannot be told from the log
+    if (get_u32(fields + 4) > cursor) {
+        put_u32(fields + 4, 0);
+    }
+    ok = ok && pwrite(fd, fields, sizeof(fields), 8) == sizeof(fields) && fdatasync(fd) == 0;
+    if (fd >= 0 && close(fd) < 0) {
+        ok = 0;
+    }
+    return ok;
+}
+
+// Summary of the group of changes at start, such as "changed
+// 2026-03-04", after the time it was made if with_time is set
+void print_change(const ChangeLog *log, size_t start, int with_time) {
+    LogEntry entry;
+    if (!log_entry_at(log, start, &entry)) {
+        return;
+    }
+    size_t days = 0;
+    long end = log_group_end(log, start);
+    LogEntry next;
+    for (size_t at = start; end >= 0 && at < (size_t)end && log_entry_at(log, at, &next); at += next.size) {
+        days++;
+    }
+
+    char text[20];
+    if (with_time) {
+        time_t when = entry.time;
+        strftime(text, sizeof(text), "%Y-%m-%d %H:%M", localtime(&when));
+        printf("%s  ", text);
+    }
+    if (entry.kind == LOG_IMPORT) {
+        printf("import of %zu day(s)", days);
+    } else if (entry.kind == LOG_RESET) {
+        printf("reset of %zu day(s)", days);
+    } else {
+        format_date(entry.date, text);
+        printf("%s %s", entry.before_records == 0 ? "added" : entry.after_records == 0 ? "deleted" : "changed", text);
+    }
+}
+
+typedef enum {
+    HISTORY_UNDO,
+    HISTORY_REDO,
+    HISTORY_RESTORE
+} HistoryMove;
+
+// Undo or redo the last group of changes, or with HISTORY_RESTORE go
+// back or forward to the changes made up to time at. Returns 0 on
+// failure.
+int move_history(HistoryMove move, time_t at) {
+    // Writers wait, so the log and the data file stay in step
+    DataView view;
+    if (!lock_data_view(&view, 1)) {
+        printf("Error: Unable to open the data file\n");
+        return 0;
+    }
+    ChangeLog log;
+    if (!load_log(&log)) {
+        close_data_view(&view);
+        return 0;
+    }
+
+    long target = log.cursor;
+    if (move == HISTORY_UNDO && log.cursor > LOG_HEADER_SIZE) {
+        target = log_group_start(&log, log.cursor);
+    } else if (move == HISTORY_REDO && log.cursor < log.size) {
+        target = log_group_end(&log, log.cursor);
+    } else if (move == HISTORY_RESTORE) {
+        // The end of the last change made at or before the time; a
+        // group's changes share their time, so this is a group boundary
+        target = LOG_HEADER_SIZE;
+        LogEntry entry;
+        for (size_t offset = LOG_HEADER_SIZE; offset < log.size; offset += entry.size) {
+            if (!log_entry_at(&log, offset, &entry)) {
+                target = -1;
+                break;
+            }
+            if ((time_t)entry.time > at) {
+                break;
+            }
+            target = offset + entry.size;
+        }
+    }
+    if (target < 0) {
+        printf("Error: The change log is damaged: %s\n", log_file_path);
+        close_data_view(&view);
+        free(log.data);
+        return 0;
+    }
+
+    long days = 0;
+    if ((size_t)target != log.cursor) {
+        days = replay_log(&log, &view, target);
+        if (days >= 0 && !save_log_cursor(target)) {
+            printf("Error: Unable to update %s\n", log_file_path);
+            days = -1;
+        }
+    }
+    close_data_view(&view);
+    if (days > 0) {
+        rebuild_summary();
+        invalidate_status();
+    }
+
+    if (days >= 0) {
+        if (move == HISTORY_RESTORE) {
+            char text[20];
+            strftime(text, sizeof(text), "%Y-%m-%d %H:%M", localtime(&at));
+            if ((size_t)target == log.cursor) {
+                printf("The data is already as of %s.\n", text);
+            } else {
+                printf("✓ Restored the data as of %s (%ld day(s) %s)\n", text, days,
+                       (size_t)target < log.cursor ? "undone" : "redone");
+            }
+        } else if ((size_t)target == log.cursor) {
+            printf("Nothing to %s.\n", move == HISTORY_UNDO ? "undo" : "redo");
+        } else {
+            printf("✓ %s: ", move == HISTORY_UNDO ? "Undone" : "Redone");
+            print_change(&log, move == HISTORY_UNDO ? (size_t)target : log.cursor, 0);
+            printf("\n");
+        }
+    }
+    free(log.data);
+    return days >= 0;
+}
+
+// The last changes, oldest first, marking the undone ones
+int show_change_log(size_t limit) {
+    ChangeLog log;
+    if (!load_log(&log)) {
+        return 0;
+    }
+    size_t groups = 0;
+    for (long at = LOG_HEADER_SIZE; at >= 0 && (size_t)at < log.size; at = log_group_end(&log, at)) {
+        groups++;
+    }
+    if (groups == 0) {
+        printf("No changes recorded.\n");
+        free(log.data);
+        return 1;
+    }
+
+    if (groups > limit) {
+        printf("(%zu earlier change(s) not shown)\n", groups - limit);
+    }
+    size_t index = 0;
+    for (long at = LOG_HEADER_SIZE; at >= 0 && (size_t)at < log.size; at = log_group_end(&log, at)) {
+        if (index++ + limit < groups) {
+            continue;
+        }
+        print_change(&log, at, 1);
+        printf((size_t)at >= log.cursor ? "  (undone)\n" : "\n");
+    }
+    free(log.data);
+    return 1;
+}
+
+// A snapshot file read into memory
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    uint32_t sequence;
+    const unsigned char *records;
+    size_t count;
+} Snapshot;
+
+void snapshot_path(uint32_t sequence, char *path, size_t size) {
+    snprintf(path, size, "%s/%06u.wts", snapshot_dir_path, sequence);
+}
+
+// Read and check a snapshot. Returns 0 if it is missing or damaged
+// (reported).
+int load_snapshot(uint32_t sequence, Snapshot *snapshot) {
+    *snapshot = (Snapshot){0};
+    char path[600];
+    snapshot_path(sequence, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    size_t size = 0;
+    unsigned char *data = fd >= 0 ? (unsigned char *)read_all(fd, &size) : NULL;
+    if (fd >= 0) {
+        close(fd);
+    }
+    size_t count = size >= SNAPSHOT_HEADER_SIZE ? (size - SNAPSHOT_HEADER_SIZE) / RECORD_SIZE : 0;
+    if (!data || size < SNAPSHOT_HEADER_SIZE || memcmp(data, SNAPSHOT_MAGIC, 4) != 0 ||
+        get_u16(data + 4) != SNAPSHOT_VERSION || get_u16(data + 6) != RECORD_SIZE ||
+        (size - SNAPSHOT_HEADER_SIZE) % RECORD_SIZE != 0 || get_u32(data + 8) != sequence ||
+        records_checksum(data + SNAPSHOT_HEADER_SIZE, count) != get_u32(data + 28)) {
+        printf("Error: Snapshot %s is missing or damaged\n", path);
+        free(data);
+        return 0;
+    }
+    snapshot->data = data;
+    snapshot->size = size;
+    snapshot->sequence = sequence;
+    snapshot->records = data + SNAPSHOT_HEADER_SIZE;
+    snapshot->count = count;
+    return 1;
+}
+
+int compare_sequences(const void *a, const void *b) {
+    uint32_t sa = *(const uint32_t *)a, sb = *(const uint32_t *)b;
+    return (sa > sb) - (sa < sb);
+}
+
+// Sequence numbers of the snapshots in the directory, in order, into a
+// new array. Returns how many, or -1 if the directory is unreadable.
+long list_snapshots(uint32_t **list) {
+    *list = NULL;
+    DIR *dir = opendir(snapshot_dir_path);
+    if (!dir) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    size_t count = 0, capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char *end;
+        unsigned long sequence = strtoul(entry->d_name, &end, 10);
+        if (end != entry->d_name + 6 || strcmp(end, ".wts") != 0 || sequence == 0) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            uint32_t *grown = realloc(*list, capacity * sizeof(uint32_t));
+            if (!grown) {
+                closedir(dir);
+                free(*list);
+                *list = NULL;
+                return -1;
+            }
+            *list = grown;
+        }
+        (*list)[count++] = sequence;
+    }
+    closedir(dir);
+    if (count > 0) {
+        qsort(*list, count, sizeof(uint32_t), compare_sequences);
+    }
+    return count;
+}
+
+// Records of the days the log changed after mark, as they are now in the
+// data file, or a record without punches for a day that is gone. The
+// first change of each day tells what it was at the last snapshot, so
+// that snapshot's checksum moved by those days must give the current
+// one; if not, the data changed without a log entry. Returns the
+// records (after room for a snapshot header), or NULL if the changes
+// cannot be told this way.
+unsigned char *snapshot_changes(const ChangeLog *log, const DataView *view, size_t mark,
+                                uint32_t checksum, size_t *count) {
+    LogEntry *entries = malloc(((log->cursor - mark) / (LOG_ENTRY_HEADER_SIZE + 2) + 1) * sizeof(LogEntry));
+    if (!entries) {
+        return NULL;
+    }
+    size_t changes = 0;
+    for (size_t at = mark; at < log->cursor; at += entries[changes++].size) {
+        if (!log_entry_at(log, at, &entries[changes])) {
+            free(entries);
+            return NULL;
+        }
+    }
+    qsort(entries, changes, sizeof(LogEntry), compare_log_entries);
+
+    unsigned char *out = malloc(SNAPSHOT_HEADER_SIZE + changes * MAX_DAY_RECORDS * RECORD_SIZE);
+    unsigned char *dst = out + SNAPSHOT_HEADER_SIZE;
+    for (size_t k = 0; out && k < changes; ) {
+        const LogEntry *first = &entries[k];
+        while (k < changes && entries[k].date == first->date) {
+            k++;
+        }
+        int found;
+        size_t i = find_day(view, first->date, &found);
+        size_t j = i;
+        while (found && j < view->count && record_date(view, j) == first->date) {
+            j++;
+        }
+        if (j - i > MAX_DAY_RECORDS) {
+            free(out);
+            out = NULL;
+            break;
+        }
+        checksum += records_checksum(view->records + i * RECORD_SIZE, j - i) -
+                    records_checksum(first->before, first->before_records);
+        if (j > i) {
+            memcpy(dst, view->records + i * RECORD_SIZE, (j - i) * RECORD_SIZE);
+            dst += (j - i) * RECORD_SIZE;
+        } else {
+            put_i32(dst, first->date);
+            for (int p = 0; p < 4; p++) {
+                put_u16(dst + 4 + p * 2, NO_PUNCH);
+            }
+            dst += RECORD_SIZE;
+        }
+    }
+    free(entries);
+    if (out && checksum != view->checksum) {
+        free(out);
+        out = NULL;
+    }
+    *count = out ? (dst - out - SNAPSHOT_HEADER_SIZE) / RECORD_SIZE : 0;
+    return out;
+}
+
+// Write records (after room for the header) as snapshot sequence
+int write_snapshot(unsigned char *out, size_t count, uint32_t sequence, const unsigned char *state, int flags) {
+    memcpy(out, SNAPSHOT_MAGIC, 4);
+    put_u16(out + 4, SNAPSHOT_VERSION);
+    put_u16(out + 6, RECORD_SIZE);
+    put_u32(out + 8, sequence);
+    memcpy(out + 12, state, 16);
+    put_u32(out + 28, records_checksum(out + SNAPSHOT_HEADER_SIZE, count));
+    put_u32(out + 32, flags);
+    put_u32(out + 36, 0);
+    char path[600];
+    snapshot_path(sequence, path, sizeof(path));
+    return write_file_atomic(path, out, SNAPSHOT_HEADER_SIZE + count * RECORD_SIZE, 1);
+}
+
+// Back up the data file into the next snapshot: only the days changed
+// since the last snapshot, as told by the change log, or every day when
+// there is no snapshot yet or the log cannot tell. The data file
+// generation shows when nothing changed. Returns 0 on failure
+// (reported).
+int take_snapshot() {
+    // Writers and other snapshots wait until the snapshot and the log
+    // mark agree
+    DataView view;
+    if (!lock_data_view(&view, 1)) {
+        printf("Error: Unable to open the data file\n");
+        return 0;
+    }
+    mkdir(snapshot_dir_path, 0700);
+    uint32_t *list;
+    long n = list_snapshots(&list);
+    Snapshot last = {0};
+    if (n < 0 || (n > 0 && !load_snapshot(list[n - 1], &last))) {
+        if (n < 0) {
+            printf("Error: Unable to read %s\n", snapshot_dir_path);
+        }
+        free(list);
+        close_data_view(&view);
+        return 0;
+    }
+    free(list);
+    if (last.data && get_u32(last.data + 12) == view.file_id && get_u32(last.data + 16) == view.generation &&
+        get_u32(last.data + 20) == view.checksum) {
+        printf("Nothing changed since snapshot %06u.\n", last.sequence);
+        close_data_view(&view);
+        free(last.data);
+        return 1;
+    }
+
+    ChangeLog log;
+    int has_log = load_log(&log);
+    size_t mark = has_log && log.data ? get_u32(log.data + 12) : 0;
+    size_t count = 0;
+    unsigned char *out = NULL;
+    if (last.data && mark != 0 && mark <= log.cursor && mark == get_u32(last.data + 24)) {
+        out = snapshot_changes(&log, &view, mark, get_u32(last.data + 20), &count);
+    }
+    int flags = out ? 0 : SNAPSHOT_FULL;
+    if (!out) {
+        out = malloc(SNAPSHOT_HEADER_SIZE + view.count * RECORD_SIZE);
+        count = view.count;
+        if (out && count > 0) {
+            memcpy(out + SNAPSHOT_HEADER_SIZE, view.records, count * RECORD_SIZE);
+        }
+    }
+
+    unsigned char state[16];
+    put_u32(state, view.file_id);
+    put_u32(state + 4, view.generation);
+    put_u32(state + 8, view.checksum);
+    put_u32(state + 12, has_log ? log.cursor : 0);
+    uint32_t sequence = last.data ? last.sequence + 1 : 1;
+    int ok = out && write_snapshot(out, count, sequence, state, flags);
+
+    // The next snapshot holds the changes logged from here on
+    if (ok && has_log && log.data) {
+        unsigned char field[4];
+        put_u32(field, log.cursor);
+        int fd = open(log_file_path, O_WRONLY);
+        if (fd < 0 || pwrite(fd, field, sizeof(field), 12) != sizeof(field) || fdatasync(fd) != 0) {
+            printf("⚠️  Unable to update %s, the next snapshot will be a full one\n", log_file_path);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    close_data_view(&view);
+    free(log.data);
+    free(out);
+
+    if (!ok) {
+        printf("Error: Unable to write the snapshot to %s\n", snapshot_dir_path);
+    } else if (flags & SNAPSHOT_FULL) {
+        printf("✓ Full snapshot %06u: %zu record(s), %zu bytes\n", sequence, count,
+               SNAPSHOT_HEADER_SIZE + count * RECORD_SIZE);
+    } else {
+        printf("✓ Snapshot %06u: %zu record(s) changed since snapshot %06u, %zu bytes\n", sequence, count,
+               last.sequence, SNAPSHOT_HEADER_SIZE + count * RECORD_SIZE);
+    }
+    free(last.data);
+    return ok;
+}
+
+// Apply the days of a later snapshot to sorted records: its days replace
+// theirs and a day without punches is removed. Returns the new records
+// (with room for a snapshot header before them), or NULL.
+unsigned char *merge_snapshot(const unsigned char *base, size_t base_count, const Snapshot *later, size_t *count) {
+    unsigned char *out = malloc(SNAPSHOT_HEADER_SIZE + (base_count + later->count) * RECORD_SIZE);
+    if (!out) {
+        return NULL;
+    }
+    unsigned char *dst = out + SNAPSHOT_HEADER_SIZE;
+    size_t i = 0, j = 0;
+    while (j < later->count) {
+        const unsigned char *rec = later->records + j * RECORD_SIZE;
+        int32_t date = get_i32(rec);
+        size_t end = j + 1;
+        while (end < later->count && get_i32(later->records + end * RECORD_SIZE) == date) {
+            end++;
+        }
+        while (i < base_count && get_i32(base + i * RECORD_SIZE) < date) {
+            memcpy(dst, base + i * RECORD_SIZE, RECORD_SIZE);
+            dst += RECORD_SIZE;
+            i++;
+        }
+        while (i < base_count && get_i32(base + i * RECORD_SIZE) == date) {
+            i++;
+        }
+        int removed = end - j == 1 && get_u16(rec + 4) == NO_PUNCH && get_u16(rec + 6) == NO_PUNCH &&
+                      get_u16(rec + 8) == NO_PUNCH && get_u16(rec + 10) == NO_PUNCH;
+        if (!removed) {
+            memcpy(dst, rec, (end - j) * RECORD_SIZE);
+            dst += (end - j) * RECORD_SIZE;
+        }
+        j = end;
+    }
+    memcpy(dst, base + i * RECORD_SIZE, (base_count - i) * RECORD_SIZE);
+    dst += (base_count - i) * RECORD_SIZE;
+    *count = (dst - out - SNAPSHOT_HEADER_SIZE) / RECORD_SIZE;
+    return out;
+}
+
+// Take a snapshot, then merge the snapshots from the last full one on
+// into one full snapshot that replaces them all. Its records must add up
+// to the checksum the data file had. With output set, the result is also
+// written there as a data file, to restore from.
+int compact_snapshots(const char *output) {
+    if (!take_snapshot()) {
+        return 0;
+    }
+    uint32_t *list;
+    long n = list_snapshots(&list);
+    if (n <= 0) {
+        printf("Error: Unable to read %s\n", snapshot_dir_path);
+        free(list);
+        return 0;
+    }
+
+    // Start from the last full snapshot; the ones before it are obsolete
+    Snapshot snapshot;
+    long first = n - 1;
+    int ok = 1;
+    while (ok && first >= 0) {
+        ok = load_snapshot(list[first], &snapshot);
+        if (ok && (get_u32(snapshot.data + 32) & SNAPSHOT_FULL)) {
+            break;
+        }
+        free(snapshot.data);
+        first--;
+    }
+    if (ok && first < 0) {
+        printf("Error: No full snapshot in %s\n", snapshot_dir_path);
+        ok = 0;
+    }
+    if (!ok) {
+        free(list);
+        return 0;
+    }
+
+    unsigned char *merged = malloc(SNAPSHOT_HEADER_SIZE + snapshot.count * RECORD_SIZE);
+    size_t count = snapshot.count;
+    if (merged) {
+        memcpy(merged + SNAPSHOT_HEADER_SIZE, snapshot.records, count * RECORD_SIZE);
+    }
+    for (long k = first + 1; merged && k < n; k++) {
+        free(snapshot.data);
+        if (!load_snapshot(list[k], &snapshot)) {
+            free(merged);
+            free(list);
+            return 0;
+        }
+        unsigned char *next = merge_snapshot(merged + SNAPSHOT_HEADER_SIZE, count, &snapshot, &count);
+        free(merged);
+        merged = next;
+    }
+
+    // snapshot is now the last one, whose state the result takes
+    ok = merged && records_checksum(merged + SNAPSHOT_HEADER_SIZE, count) == get_u32(snapshot.data + 20);
+    if (merged && !ok) {
+        printf("Error: The snapshots do not add up to the data they were taken from, nothing compacted\n");
+    }
+    unsigned char state[16];
+    memcpy(state, snapshot.data + 12, sizeof(state));
+    free(snapshot.data);
+    ok = ok && write_snapshot(merged, count, list[n - 1], state, SNAPSHOT_FULL);
+
+    if (ok) {
+        char path[600];
+        for (long k = 0; k < n - 1; k++) {
+            snapshot_path(list[k], path, sizeof(path));
+            unlink(path);
+        }
+        // The merged snapshot is in the same directory, also with a single one
+        snapshot_path(list[n - 1], path, sizeof(path));
+        sync_parent_dir(path);
+        printf("✓ Compacted %ld snapshot(s) into %06u: %zu record(s), %zu bytes\n", n - first, list[n - 1],
+               count, SNAPSHOT_HEADER_SIZE + count * RECORD_SIZE);
+    }
+    if (ok && output) {
+        // The merged records become a data file with a new header
+        unsigned char *data = merged + SNAPSHOT_HEADER_SIZE - HEADER_SIZE;
+        init_header(data);
+        put_u32(data + 16, records_checksum(data + HEADER_SIZE, count));
+        ok = write_file_atomic(output, data, HEADER_SIZE + count * RECORD_SIZE, 1);
+        if (ok) {
+            printf("✓ Wrote the data as of snapshot %06u to %s\n", list[n - 1], output);
+        } else {
+            printf("Error: Unable to write %s\n", output);
+        }
+    }
+    free(merged);
+    free(list);
+    return ok;
+}
+
+// Arrival, breaks and departure of a completed day, one per line
+void print_day_times(const WorkDay *day) {
+    char start[8], end[8];
+    format_punch(day->punches[0], start);
+    printf("Arrival:         %s\n", start);
+    for (int i = 2; i < day->punch_count; i += 2) {
+        format_punch(day->punches[i - 1], start);
+        format_punch(day->punches[i], end);
+        printf("Break:           %s - %s\n", start, end);
+    }
+    format_punch(day->punches[day->punch_count - 1], end);
+    printf("Departure:       %s\n", end);
+}
+
+// Totals block printed once a day is saved
+void print_day_totals(const WorkDay *day) {
+    printf("-------------------------------------------\n");
+    printf("Time worked:     %02d:%02d\n", day->worked_minutes / 60, day->worked_minutes % 60);
+    int required = day->worked_minutes - day->excess_minutes;
+    printf("Required:        %02d:%02d\n", required / 60, required % 60);
+    printf("Difference:      ");
+    print_time_diff(day->excess_minutes);
+    printf("\n===========================================\n");
+}
+
+void save_completed_day(WorkDay *day) {
+    calculate_day_totals(day);
+
+    day->state = STATE_COMPLETED;
+
+    if (store_day(day)) {
+        printf("\n✓ Day saved!\n");
+        printf("===========================================\n");
+        print_day_times(day);
+        print_day_totals(day);
+
+        delete_temp_day();
+    } else {
+        printf("Error: Unable to save data\n");
+    }
+}
+
+void calculate_end_time(WorkDay *day) {
+    char end[8];
+    format_punch(expected_end_minutes(day), end);
+    
+    printf("\n===========================================\n");
+    printf("You should finish at: %s\n", end);
+    printf("===========================================\n");
+}
+
+typedef enum {
+    PUNCH_IN,
+    PUNCH_LUNCH,
+    PUNCH_BACK,
+    PUNCH_OUT
+} PunchKind;
+
+// Punch names, and the state names of a day once each punch is done
+const char *punch_names[] = {"in", "lunch", "back", "out"};
+const char *state_names[] = {"none", "in", "lunch", "back", "out"};
+
+int parse_punch(const char *name, PunchKind *kind) {
+    // Any break is punched like the lunch break
+    if (strcmp(name, "break") == 0) {
+        *kind = PUNCH_LUNCH;
+        return 1;
+    }
+    for (int i = PUNCH_IN; i <= PUNCH_OUT; i++) {
+        if (strcmp(name, punch_names[i]) == 0) {
+            *kind = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Record the next punch of a day at minutes after midnight of its date.
+// Returns NULL, or why the punch does not fit the day.
+const char *apply_punch(WorkDay *day, PunchKind kind, int minutes) {
+    static const char *expected[] = {
+        "Next punch is 'in'", "Next punch is 'lunch' or 'out'",
+        "Next punch is 'back'", "Next punch is 'lunch' or 'out'", "Day already completed"
+    };
+    // While working, a break or the departure may come next
+    int working = day->state == STATE_STARTED || day->state == STATE_LUNCH_END;
+    int fits = kind == PUNCH_IN ? day->state == STATE_NEW
+             : kind == PUNCH_BACK ? day->state == STATE_LUNCH_START
+             : working;
+    if (!fits) {
+        return expected[day->state];
+    }
+    // Room is kept for the departure after the last break
+    if (kind == PUNCH_LUNCH && day->punch_count + 3 > MAX_PUNCHES) {
+        return "Too many breaks in one day";
+    }
+
+    // A time shortly before the previous punch is after midnight
+    day->punches[day->punch_count++] = minutes;
+    const char *error = order_punches(day);
+    if (error) {
+        day->punch_count--;
+        return error;
+    }
+    static const DayState next[] = {STATE_STARTED, STATE_LUNCH_START, STATE_LUNCH_END, STATE_COMPLETED};
+    day->state = next[kind];
+    if (day->state == STATE_COMPLETED) {
+        calculate_day_totals(day);
+    }
+    return NULL;
+}
+
+// Save a day after a punch: the in-progress file, or the data file once
+// the day is completed
+int save_punch(WorkDay *day) {
+    if (day->state != STATE_COMPLETED) {
+        return save_temp_day(day);
+    }
+    if (!store_day(day)) {
+        return 0;
+    }
+    delete_temp_day();
+    save_status(day);
+    return 1;
+}
+
+// Whether the data file already has a day, copied to *day unless NULL.
+// Only the last records are read when the date is recent.
+int day_recorded(int date, WorkDay *day) {
+    int fd = open_locked_data_file(O_RDONLY, F_RDLCK, 0);
+    if (fd < 0) {
+        return 0;
+    }
+    DataView view;
+    int found = 0;
+    if (map_data_view(fd, &view)) {
+        size_t index = find_day(&view, date, &found);
+        if (found && day) {
+            read_day(&view, index, day);
+        }
+    }
+    view.fd = fd;
+    close_data_view(&view);
+    return found;
+}
+
+// Parse a time typed at a prompt: H:MM, HH:MM (+1 for the day after),
+// HMM, HHMM, "now", or an offset such as +15m, +1h or +1h30m (- for
+// earlier) from base, in minutes, or from now if base is negative.
+// Returns 0 if invalid.
+int parse_clock(const char *text, int base, int *minutes) {
+    size_t len = strlen(text);
+    if (parse_punch_time(text, minutes)) {
+        return 1;
+    }
+    if ((len == 3 || len == 4) && strspn(text, "0123456789") == len) {
+        int value = atoi(text);
+        if (value / 100 > 23 || value % 100 > 59) {
+            return 0;
+        }
+        *minutes = time_to_minutes(value / 100, value % 100);
+        return 1;
+    }
+    if (strcmp(text, "now") == 0) {
+        *minutes = current_minutes();
+        return 1;
+    }
+    if (text[0] != '+' && text[0] != '-') {
+        return 0;
+    }
+
+    // Hours then minutes, each at most once
+    int offset = 0, units = 0;
+    for (const char *p = text + 1; *p; ) {
+        char *end;
+        long n = *p >= '0' && *p <= '9' ? strtol(p, &end, 10) : -1;
+        if (n < 0 || n >= MINUTES_PER_DAY) {
+            return 0;
+        }
+        if (*end == 'h' && units == 0) {
+            offset += n * 60;
+            units = 1;
+        } else if (*end == 'm' && units < 2) {
+            offset += n;
+            units = 2;
+        } else {
+            return 0;
+        }
+        p = end + 1;
+    }
+    if (units == 0 || offset >= MINUTES_PER_DAY) {
+        return 0;
+    }
+    if (text[0] == '-') {
+        offset = -offset;
+    }
+    if (base >= 0) {
+        // Counted like the punches, so it can run past midnight
+        *minutes = base + offset;
+        return *minutes >= 0;
+    }
+    *minutes = (current_minutes() + offset + MINUTES_PER_DAY) % MINUTES_PER_DAY;
+    return 1;
+}
+
+// Ask for a time (see parse_clock(); an offset is from the punch before,
+// base). With allow_break set, "b" asks for another break instead and 2
+// is returned. Returns 0 on invalid input or at the end of input.
+int prompt_time(const char *prompt, int base, int *minutes, int allow_break) {
+    printf("%s", prompt);
+    char line[16];
+    int got = read_line(line, sizeof(line));
+    if (got == 0) {
+        printf("\n");
+        return 0;
+    }
+    if (allow_break && (strcmp(line, "b") == 0 || strcmp(line, "B") == 0)) {
+        return 2;
+    }
+    if (got < 0 || !parse_clock(line, base, minutes)) {
+        printf("Invalid time, use HH:MM, HHMM, now or an offset like +15m\n");
+        return 0;
+    }
+    if (base < 0) {
+        return 1;
+    }
+
+    // Once past midnight, clock times are on the day after. Before that,
+    // a time earlier than the previous punch only is if the user says so.
+    char previous[8], typed[8];
+    format_punch(base, previous);
+    format_punch(*minutes, typed);
+    if (base >= MINUTES_PER_DAY && *minutes < MINUTES_PER_DAY) {
+        *minutes += MINUTES_PER_DAY;
+    } else if (*minutes < base && *minutes < MINUTES_PER_DAY) {
+        printf("%s is before the previous punch (%s). Is it after midnight? (y/n): ", typed, previous);
+        if (!read_yes()) {
+            return 0;
+        }
+        *minutes += MINUTES_PER_DAY;
+    }
+    if (*minutes < base) {
+        printf("Invalid time, it must not be before %s\n", previous);
+        return 0;
+    }
+    return 1;
+}
+
+// Ask for the punches a day is missing, in order, until it is completed.
+// After the first break the departure may be replaced by another break.
+// With save set, the day in progress is saved after each punch so it can
+// be resumed. Returns 0 if an answer was invalid.
+int prompt_punches(WorkDay *day, int save) {
+    static const char *prompts[] = {
+        "Arrival time (HH:MM): ", "Lunch break start (HH:MM): ", "Break end (HH:MM): "
+    };
+    while (day->state != STATE_COMPLETED) {
+        PunchKind kind = (PunchKind)day->state;
+        int previous = day->punch_count > 0 ? day->punches[day->punch_count - 1] : -1;
+        int minutes, answer;
+        if (day->state == STATE_LUNCH_END) {
+            answer = prompt_time("\nDeparture time (HH:MM, or b for another break): ", previous, &minutes, 1);
+            if (answer == 2) {
+                kind = PUNCH_LUNCH;
+                answer = prompt_time("Break start (HH:MM): ", previous, &minutes, 0);
+            }
+        } else {
+            answer = prompt_time(prompts[day->state], previous, &minutes, 0);
+        }
+        if (!answer) {
+            return 0;
+        }
+
+        const char *error = apply_punch(day, kind, minutes);
+        if (error) {
+            printf("%s\n", error);
+            return 0;
+        }
+        if (save && day->state != STATE_COMPLETED && !save_temp_day(day)) {
+            printf("Error: Unable to save the day in progress\n");
+            return 0;
+        }
+        if (save && kind == PUNCH_BACK) {
+            calculate_end_time(day);
+        }
+    }
+    return 1;
+}
+
+// Punches of a day in progress, as a checklist
+void print_recorded_punches(const WorkDay *day) {
+    char text[8];
+    if (day->punch_count > 0) {
+        format_punch(day->punches[0], text);
+        printf("✓ Arrival: %s\n", text);
+    }
+    for (int i = 1; i < day->punch_count; i += 2) {
+        format_punch(day->punches[i], text);
+        printf("✓ Break: %s - ", text);
+        if (i + 1 < day->punch_count) {
+            format_punch(day->punches[i + 1], text);
+            printf("%s\n", text);
+        } else {
+            printf("...\n");
+        }
+    }
+}
+
+void enter_day_data() {
+    is_editing = 1;
+
+    // Load temporary data if it exists
+    int has_temp = load_temp_day(&current_day);
+
+    if (has_temp) {
+        char date[11];
+        format_date(current_day.date, date);
+        printf("\n=== RESUMING DAY: %s ===\n", date);
+        printf("\n📌 Already recorded:\n");
+        print_recorded_punches(&current_day);
+        printf("\n");
+    } else {
+        // Initialize a new day
+        current_day = (WorkDay){0};
+        current_day.date = get_current_date();
+        char date[11];
+        format_date(current_day.date, date);
+
+        // Check if this date already exists in completed history
+        WorkDay existing;
+        if (day_recorded(current_day.date, &existing)) {
+            char start[8], end[8];
+            format_punch(existing.punches[0], start);
+            format_punch(existing.punches[existing.punch_count - 1], end);
+            printf("\n⚠️  An entry already exists for today (%s)!\n", date);
+            printf("Arrival: %s, Departure: %s\n", start, end);
+            printf("Time worked: %02d:%02d\n\n",
+                   existing.worked_minutes / 60, existing.worked_minutes % 60);
+            printf("You cannot create a new entry for today.\n");
+            printf("Please use option 3 (Modify entry) if you need to change it.\n");
+            is_editing = 0;
+            return;
+        }
+
+        current_day.state = STATE_NEW;
+        printf("\n=== NEW DAY: %s ===\n", date);
+    }
+    
+    printf("\n💡 You can press Ctrl+C at any time to save and quit\n");
+    printf("💡 Times: HH:MM, HHMM, now, or +15m after the previous punch\n\n");
+    
+    if (prompt_punches(&current_day, 1)) {
+        save_completed_day(&current_day);
+    }
+    
+    is_editing = 0;
 }
 
 void add_past_day() {
     WorkDay day = {0};
     
-    printf("\n=== ADD PAST DAY ===\n\n");
+    printf("\n=== ADD PAST DAY ===\n\n");
+    
+    // Enter date
+    char date[16];
+    printf("Date (YYYY-MM-DD): ");
+    if (read_line(date, sizeof(date)) == 0) {
+        printf("\n");
+        return;
+    }
+    
+    // Check date format
+    if (!parse_date(date, &day.date)) {
+        printf("Invalid date format. Use YYYY-MM-DD (e.g., 2026-02-03)\n");
+        return;
+    }
+    
+    // Check if this date already exists
+    WorkDay existing;
+    if (day_recorded(day.date, &existing)) {
+        char start[8], end[8];
+        format_punch(existing.punches[0], start);
+        format_punch(existing.punches[existing.punch_count - 1], end);
+        printf("\n⚠️  An entry already exists for this date!\n");
+        printf("Arrival: %s, Departure: %s\n", start, end);
+        printf("\nDo you want to replace it? (y/n): ");
+        if (!read_yes()) {
+            return;
+        }
+        // Continue to replace
+    }
+    
+    printf("\nEntering times for %s:\n\n", date);
+    
+    if (!prompt_punches(&day, 0)) {
+        return;
+    }
+    
+    // Save - store_day keeps the chronological order
+    if (store_day(&day)) {
+        printf("\n✓ Day %s saved!\n", date);
+        printf("===========================================\n");
+        print_day_times(&day);
+        print_day_totals(&day);
+    } else {
+        printf("Error: Unable to save data\n");
+    }
+}
+
+// Ask for the breaks of a day again, keeping its arrival and departure
+int prompt_breaks(WorkDay *day) {
+    int arrival = day->punches[0];
+    int departure = day->punches[day->punch_count - 1];
+
+    printf("\nNumber of breaks (0-%d): ", MAX_PUNCHES / 2 - 1);
+    int breaks;
+    if (!read_number(&breaks) || breaks < 0 || breaks > MAX_PUNCHES / 2 - 1) {
+        printf("Invalid input\n");
+        return 0;
+    }
+
+    day->punch_count = 0;
+    day->punches[day->punch_count++] = arrival;
+    for (int i = 1; i <= breaks; i++) {
+        char prompt[64];
+        int start, end;
+        snprintf(prompt, sizeof(prompt), "Break %d start (HH:MM): ", i);
+        if (!prompt_time(prompt, day->punches[day->punch_count - 1], &start, 0)) {
+            return 0;
+        }
+        snprintf(prompt, sizeof(prompt), "Break %d end (HH:MM): ", i);
+        if (!prompt_time(prompt, start, &end, 0)) {
+            return 0;
+        }
+        day->punches[day->punch_count++] = start;
+        day->punches[day->punch_count++] = end;
+    }
+    day->punches[day->punch_count++] = departure;
+    return 1;
+}
+
+void modify_entry() {
+    DataView view;
+    if (!open_data_view(&view)) {
+        printf("\nNo history found.\n");
+        return;
+    }
+    
+    if (view.count == 0) {
+        printf("\nNo entries to modify.\n");
+        close_data_view(&view);
+        return;
+    }
     
-    // Enter date
-    printf("Date (YYYY-MM-DD): ");
-    if (scanf("%10s", day.date) != 1) {
-        clear_input_buffer();
-        printf("Invalid format\n");
+    // Display all entries with numbers
+    fflush(stdout);
+    OutBuf out = {.fd = STDOUT_FILENO};
+    out_str(&out, "\n=== MODIFY ENTRY ===\n\n");
+    out_str(&out, "Available entries:\n");
+    out_str(&out, "========================================================================================================\n");
+    out_str(&out, "ID | Date       | Start  | Breaks     | End    | Time worked | Difference\n");
+    out_str(&out, "========================================================================================================\n");
+    
+    int page = page_rows();
+    int id = 0;
+    size_t i = 0;
+    while (i < view.count) {
+        WorkDay entry;
+        i += read_day(&view, i, &entry);
+        render_day_row(&out, &entry, ++id);
+        if (page && id % page == 0 && i < view.count && !more_prompt(&out)) {
+            break;
+        }
+    }
+    out_str(&out, "========================================================================================================\n");
+    out_flush(&out);
+    close_data_view(&view);
+    
+    // Ask which entry to modify
+    printf("\nEnter the ID of the entry to modify (or 0 to cancel): ");
+    if (!read_number(&id)) {
+        printf("Invalid input\n");
+        return;
+    }
+    
+    // Only the selected day is copied, and the file is not kept locked
+    // while the user types
+    WorkDay entry;
+    int found = 0;
+    if (id >= 1 && open_data_view(&view)) {
+        i = 0;
+        for (int n = 1; i < view.count && n < id; n++) {
+            i += read_day(&view, i, &entry);
+        }
+        if (i < view.count) {
+            read_day(&view, i, &entry);
+            found = 1;
+        }
+    }
+    close_data_view(&view);
+    if (!found) {
+        if (id != 0) {
+            printf("Invalid ID\n");
+        }
+        return;
+    }
+    WorkDay *day = &entry;
+    
+    char date[11];
+    format_date(day->date, date);
+    printf("\n=== MODIFYING: %s ===\n", date);
+    printf("Current values:\n");
+    print_day_times(day);
+    printf("\n");
+    
+    // Menu for what to modify
+    printf("What do you want to modify?\n");
+    printf("1. Arrival time\n");
+    printf("2. Breaks\n");
+    printf("3. Departure time\n");
+    printf("4. Modify all times\n");
+    printf("5. Delete this entry\n");
+    printf("0. Cancel\n");
+    printf("\nChoice: ");
+    
+    int choice;
+    if (!read_number(&choice)) {
+        printf("Invalid input\n");
+        return;
+    }
+    
+    switch (choice) {
+        case 0:
+            return;
+            
+        case 1:
+            if (!prompt_time("\nNew arrival time (HH:MM): ", -1, &day->punches[0], 0)) {
+                return;
+            }
+            break;
+            
+        case 2:
+            if (!prompt_breaks(day)) {
+                return;
+            }
+            break;
+            
+        case 3:
+            if (!prompt_time("\nNew departure time (HH:MM): ", day->punches[day->punch_count - 2],
+                             &day->punches[day->punch_count - 1], 0)) {
+                return;
+            }
+            break;
+            
+        case 4:
+            if (!prompt_time("\nNew arrival time (HH:MM): ", -1, &day->punches[0], 0) ||
+                !prompt_breaks(day) ||
+                !prompt_time("New departure time (HH:MM): ", day->punches[day->punch_count - 2],
+                             &day->punches[day->punch_count - 1], 0)) {
+                return;
+            }
+            break;
+            
+        case 5:
+            printf("\nAre you sure you want to delete this entry? (y/n): ");
+            if (read_yes()) {
+                if (delete_day(day->date)) {
+                    printf("✓ Entry deleted.\n");
+                } else {
+                    printf("Error: Unable to save changes\n");
+                }
+            }
+            return;
+            
+        default:
+            printf("Invalid choice\n");
+            return;
+    }
+    
+    const char *error = order_punches(day);
+    if (error) {
+        printf("%s, entry not changed\n", error);
+        return;
+    }
+    
+    // Recalculate worked minutes and excess
+    calculate_day_totals(day);
+    
+    // Patch the records in place
+    if (store_day(day)) {
+        printf("\n✓ Entry updated!\n");
+        printf("===========================================\n");
+        printf("Date:            %s\n", date);
+        print_day_times(day);
+        print_day_totals(day);
+    } else {
+        printf("Error: Unable to save changes\n");
+    }
+}
+
+void show_current_status() {
+    WorkDay day;
+    
+    if (!load_temp_day(&day)) {
+        printf("\nNo day in progress.\n");
+        return;
+    }
+    
+    printf("\n╔════════════════════════════════════════╗\n");
+    printf("║        DAY IN PROGRESS                 ║\n");
+    printf("╚════════════════════════════════════════╝\n");
+    char date[11];
+    format_date(day.date, date);
+    printf("\nDate: %s\n", date);
+    
+    print_recorded_punches(&day);
+    
+    if (day.state >= STATE_LUNCH_END) {
+        // Recalculate expected end time
+        char end[8];
+        format_punch(expected_end_minutes(&day), end);
+        printf("\n→ Expected end time: %s\n", end);
+    }
+    
+    printf("\nNext step: ");
+    switch (day.state) {
+        case STATE_NEW:
+            printf("Record arrival time\n");
+            break;
+        case STATE_STARTED:
+            printf("Record lunch break start or departure\n");
+            break;
+        case STATE_LUNCH_START:
+            printf("Record break end\n");
+            break;
+        case STATE_LUNCH_END:
+            printf("Record departure time or another break\n");
+            break;
+        default:
+            printf("Unknown\n");
+    }
+}
+
+void show_history() {
+    DataView view;
+    int has_file = open_data_view(&view);
+    WorkDay temp_day;
+    int has_temp = load_temp_day(&temp_day);
+    
+    if (!has_file && !has_temp) {
+        printf("\nNo history found.\n");
         return;
     }
-    clear_input_buffer();
-    
-    // Check date format (basic)
-    if (strlen(day.date) != 10 || day.date[4] != '-' || day.date[7] != '-') {
-        printf("Invalid date format. Use YYYY-MM-DD (e.g., 2026-02-03)\n");
-        return;
+    
+    // Totals come from the cache, so they do not depend on what is listed
+    Summary summary = {0};
+    get_summary(&summary, &view);
+    
+    // Rows are formatted into one buffer and written in large chunks
+    fflush(stdout);
+    OutBuf out = {.fd = STDOUT_FILENO};
+    out_str(&out, "\n========================================================================================================\n");
+    out_str(&out, "Date       | Start  | Breaks     | End    | Time worked     | Required | Difference\n");
+    out_str(&out, "========================================================================================================\n");
+    
+    // Walk the completed days straight from the mapping
+    int page = page_rows();
+    int rows = 0;
+    size_t i = 0;
+    while (i < view.count) {
+        WorkDay day;
+        i += read_day(&view, i, &day);
+        render_day_row(&out, &day, 0);
+        if (page && ++rows % page == 0 && i < view.count && !more_prompt(&out)) {
+            break;
+        }
+    }
+    
+    // Show day in progress if it exists
+    if (has_temp) {
+        out_date(&out, temp_day.date);
+        out_str(&out, " | ");
+        
+        // Show what's been recorded
+        if (temp_day.state >= STATE_STARTED) {
+            out_clock(&out, temp_day.punches[0]);
+            out_str(&out, "  | ");
+        } else {
+            out_str(&out, "--:--  | ");
+        }
+        
+        out_breaks(&out, &temp_day);
+        out_str(&out, " | ");
+        
+        if (temp_day.state >= STATE_LUNCH_END) {
+            out_str(&out, "~");
+            out_spaces(&out, 6 - out_punch(&out, expected_end_minutes(&temp_day)));
+            out_str(&out, "| ");
+        } else {
+            out_str(&out, "??:?? | ");
+        }
+        
+        out_str(&out, "IN PROGRESS     | ");
+        out_clock(&out, required_minutes(temp_day.date));
+        out_str(&out, "    | IN PROGRESS\n");
+    }
+    
+    out_str(&out, "========================================================================================================\n");
+    close_data_view(&view);
+    
+    if (summary.days > 0) {
+        // Current month, then everything recorded so far
+        int this_month = month_of(get_current_date());
+        int month_excess = 0;
+        for (size_t i = summary.count; i > 0; i--) {
+            if (summary.months[i - 1].month == this_month) {
+                month_excess = summary.months[i - 1].excess;
+                break;
+            }
+        }
+        out_str(&out, "MONTH EXCESS:       ");
+        out_time_diff(&out, month_excess);
+        out_str(&out, "\nTOTAL EXCESS:       ");
+        out_time_diff(&out, summary.excess);
+        if (has_temp) {
+            out_str(&out, " (excluding day in progress)");
+        }
+        out_str(&out, "\n"); 
+    }
+    
+    out_str(&out, "========================================================================================================\n");
+    out_flush(&out);
+    free_summary(&summary);
+}
+
+// Month by month table of a summary, with a running balance
+void render_summary(OutBuf *out, const Summary *summary) {
+    out_str(out, "Month   | Days | Worked    | Excess    | Balance\n");
+    out_str(out, "==================================================\n");
+    long long balance = 0;
+    for (size_t i = 0; i < summary->count; i++) {
+        const MonthTotals *totals = &summary->months[i];
+        char date[11];
+        int year = totals->month / 12;
+        format_date(days_from_civil(year, totals->month - year * 12 + 1, 1), date);
+        balance += totals->excess;
+
+        out_bytes(out, date, 7);
+        out_str(out, " | ");
+        out_int_width(out, totals->days, 4);
+        out_str(out, " | ");
+        out_spaces(out, 9 - out_duration(out, totals->worked));
+        out_str(out, " | ");
+        out_spaces(out, 9 - out_time_diff(out, totals->excess));
+        out_str(out, " | ");
+        out_time_diff(out, balance);
+        out_str(out, "\n");
+    }
+    out_str(out, "==================================================\n");
+    out_str(out, "Total: ");
+    out_int(out, summary->days);
+    out_str(out, " days, worked ");
+    out_duration(out, summary->worked);
+    out_str(out, ", balance ");
+    out_time_diff(out, summary->excess);
+    out_str(out, "\n");
+}
+
+int show_balance() {
+    DataView view;
+    if (!open_history(&view)) {
+        return 0;
+    }
+    Summary summary = {0};
+    get_summary(&summary, &view);
+    close_data_view(&view);
+
+    OutBuf out = {.fd = STDOUT_FILENO};
+    render_summary(&out, &summary);
+    fflush(stdout);
+    out_flush(&out);
+    free_summary(&summary);
+    return !out.failed;
+}
+
+void reset_data() {
+    printf("\nAre you sure you want to delete all data? (y/n): ");
+    if (read_yes()) {
+        // The days go into the change log first, so undo brings them back.
+        // A damaged data file cannot be logged, and is deleted all the same.
+        DataView view;
+        if (lock_data_view(&view, 1) && !log_all_deleted(&view)) {
+            close_data_view(&view);
+            printf("Error: Unable to record the data in the change log, nothing deleted\n");
+            return;
+        }
+        remove(data_file_path);
+        close_data_view(&view);
+        remove(temp_file_path);
+        remove(summary_file_path);
+        remove(journal_file_path);
+        remove(status_file_path);
+        printf("✓ Data deleted (worktracker undo brings it back).\n");
+    }
+}
+
+// Elapsed time since start, in seconds
+double seconds_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+typedef struct {
+    int date;
+    size_t line;
+    size_t records;
+    unsigned char rec[MAX_DAY_RECORDS * RECORD_SIZE];
+} ImportRow;
+
+int compare_import_rows(const void *a, const void *b) {
+    const ImportRow *ra = a, *rb = b;
+    if (ra->date != rb->date) {
+        return ra->date < rb->date ? -1 : 1;
+    }
+    return (ra->line > rb->line) - (ra->line < rb->line);
+}
+
+// Split one CSV line into at most max fields, trimming blanks around each
+int split_fields(char *line, char **fields, int max) {
+    int n = 0;
+    char *p = line;
+    while (n < max) {
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        fields[n++] = p;
+        char *comma = strchr(p, ',');
+        char *end = comma ? comma : p + strlen(p);
+        while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+            end--;
+        }
+        if (!comma) {
+            *end = '\0';
+            return n;
+        }
+        *end = '\0';
+        p = comma + 1;
+    }
+    return n + 1;
+}
+
+// A row written by export: date,arrival,lunch_start,lunch_end,departure,
+// worked_minutes,excess_minutes,other_breaks (see export_csv_day()).
+// Returns 0 if it is invalid.
+int parse_export_row(char **fields, WorkDay *day) {
+    int n = 0;
+    int ok = parse_date(fields[0], &day->date) && parse_punch_time(fields[1], &day->punches[n++]);
+    int lunch = fields[2][0] || fields[3][0];
+    if (ok && lunch) {
+        ok = parse_punch_time(fields[2], &day->punches[n++]) && parse_punch_time(fields[3], &day->punches[n++]);
+    }
+    for (char *p = strtok(fields[7], " \t"); ok && p; p = strtok(NULL, " \t")) {
+        char *dash = strchr(p, '-');
+        ok = lunch && dash && n + 3 <= MAX_PUNCHES;
+        if (ok) {
+            *dash = '\0';
+            ok = parse_punch_time(p, &day->punches[n++]) && parse_punch_time(dash + 1, &day->punches[n++]);
+        }
+    }
+    ok = ok && parse_punch_time(fields[4], &day->punches[n++]);
+    day->punch_count = n;
+    return ok;
+}
+
+// Load days from CSV (date,arrival,break start,break end,...,departure)
+// and merge them into the data file with a single write. Rows for a date
+// that is already recorded replace it; the last row for a date wins.
+int import_days(const char *path) {
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Error: Unable to open %s\n", path);
+        return 0;
+    }
+    size_t size;
+    char *text = read_all(fd, &size);
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    if (!text) {
+        printf("Error: Unable to read %s\n", path);
+        return 0;
+    }
+
+    size_t max_rows = 1;
+    for (size_t i = 0; i < size; i++) {
+        max_rows += text[i] == '\n';
+    }
+    ImportRow *rows = malloc(max_rows * sizeof(ImportRow));
+    if (!rows) {
+        free(text);
+        printf("Error: Out of memory\n");
+        return 0;
+    }
+
+    size_t count = 0, errors = 0, line_no = 0;
+    char *line = text;
+    while (line < text + size) {
+        char *next = strchr(line, '\n');
+        if (next) {
+            *next++ = '\0';
+        } else {
+            next = text + size;
+        }
+        line_no++;
+
+        // Derived columns written by export are accepted and ignored
+        char *fields[MAX_PUNCHES + 3];
+        int n = split_fields(line, fields, MAX_PUNCHES + 3);
+        if (n == 1 && fields[0][0] == '\0') {
+            line = next;
+            continue;
+        }
+        if (fields[0][0] == '#' || (line_no == 1 && strcmp(fields[0], "date") == 0)) {
+            line = next;
+            continue;
+        }
+
+        // The two derived columns are the only ones without a colon: after
+        // the departure, or in the middle of a row written by export
+        ImportRow *row = &rows[count];
+        WorkDay day = {.state = STATE_COMPLETED};
+        int ok;
+        if (n > MAX_PUNCHES + 3) {
+            // split_fields() stopped at the limit, the last field is not set
+            ok = 0;
+        } else if (n == 8 && !strchr(fields[5], ':') && !strchr(fields[6], ':')) {
+            ok = parse_export_row(fields, &day);
+        } else {
+            int times = n - 1;
+            if (times >= 4 && !strchr(fields[n - 1], ':') && !strchr(fields[n - 2], ':')) {
+                times -= 2;
+            }
+            ok = times >= 2 && times <= MAX_PUNCHES && times % 2 == 0 &&
+                 parse_date(fields[0], &day.date);
+            for (int i = 0; ok && i < times; i++) {
+                ok = parse_punch_time(fields[i + 1], &day.punches[i]);
+            }
+            day.punch_count = times;
+        }
+        const char *error = ok ? order_punches(&day) : NULL;
+        if (!ok || error) {
+            if (errors < 10 && error) {
+                printf("Line %zu: %s\n", line_no, error);
+            } else if (errors < 10) {
+                printf("Line %zu: expected YYYY-MM-DD,HH:MM,HH:MM[,HH:MM,HH:MM...]\n", line_no);
+            }
+            errors++;
+            line = next;
+            continue;
+        }
+
+        row->records = encode_day(&day, row->rec);
+        row->date = day.date;
+        row->line = line_no;
+        count++;
+        line = next;
+    }
+    free(text);
+
+    if (errors > 0) {
+        printf("✗ %zu invalid line(s), nothing imported.\n", errors);
+        free(rows);
+        return 0;
+    }
+    if (count == 0) {
+        printf("Nothing to import.\n");
+        free(rows);
+        return 1;
+    }
+
+    // Sort by date, keeping file order between rows for the same date
+    int sorted = 1;
+    for (size_t i = 1; i < count && sorted; i++) {
+        sorted = rows[i - 1].date < rows[i].date;
+    }
+    if (!sorted) {
+        qsort(rows, count, sizeof(ImportRow), compare_import_rows);
+    }
+
+    // Other processes wait until the new file is in place
+    DataView view;
+    if (!lock_data_view(&view, 1)) {
+        free(rows);
+        printf("Error: Unable to open the data file\n");
+        return 0;
+    }
+
+    size_t records = 0;
+    for (size_t j = 0; j < count; j++) {
+        records += rows[j].records;
+    }
+    unsigned char *out = malloc(HEADER_SIZE + (view.count + records) * RECORD_SIZE);
+    unsigned char *log_entries = malloc(count * LOG_ENTRY_MAX);
+    if (!out || !log_entries) {
+        close_data_view(&view);
+        free(rows);
+        free(out);
+        free(log_entries);
+        printf("Error: Out of memory\n");
+        return 0;
+    }
+    init_header(out);
+    if (view.generation || view.file_id) {
+        put_u32(out + 8, view.generation + 1);
+        put_u32(out + 12, view.file_id);
+    }
+
+    // Merge the two sorted sequences; imported rows win on equal dates.
+    // Each day imported goes into the change log, as one group.
+    unsigned char *dst = out + HEADER_SIZE;
+    size_t i = 0, j = 0, added = 0, replaced = 0, log_size = 0;
+    uint32_t now = (uint32_t)time(NULL);
+    while (j < count) {
+        if (j + 1 < count && rows[j + 1].date == rows[j].date) {
+            j++;
+            continue;
+        }
+        int date = rows[j].date;
+        while (i < view.count && record_date(&view, i) < date) {
+            memcpy(dst, view.records + i * RECORD_SIZE, RECORD_SIZE);
+            dst += RECORD_SIZE;
+            i++;
+        }
+        size_t old = i;
+        if (i < view.count && record_date(&view, i) == date) {
+            replaced++;
+            while (i < view.count && record_date(&view, i) == date) {
+                i++;
+            }
+        } else {
+            added++;
+        }
+        if (i - old <= MAX_DAY_RECORDS) {
+            log_size += encode_log_entry(log_entries + log_size, LOG_IMPORT, log_size == 0 ? LOG_GROUP_START : 0,
+                                         now, date, view.records + old * RECORD_SIZE, i - old,
+                                         rows[j].rec, rows[j].records);
+        }
+        memcpy(dst, rows[j].rec, rows[j].records * RECORD_SIZE);
+        dst += rows[j].records * RECORD_SIZE;
+        j++;
+    }
+    if (i < view.count) {
+        memcpy(dst, view.records + i * RECORD_SIZE, (view.count - i) * RECORD_SIZE);
+        dst += (view.count - i) * RECORD_SIZE;
     }
-    
-    // Check if this date already exists
-    FILE *file = fopen(data_file_path, "rb");
-    if (file) {
-        WorkDay existing;
-        while (fread(&existing, sizeof(WorkDay), 1, file) == 1) {
-            if (strcmp(existing.date, day.date) == 0) {
-                printf("\n⚠️  An entry already exists for this date!\n");
-                printf("Arrival: %02d:%02d, Departure: %02d:%02d\n", 
-                       existing.start_hour, existing.start_min,
-                       existing.end_hour, existing.end_min);
-                printf("\nDo you want to replace it? (y/n): ");
-                char choice;
-                scanf("%c", &choice);
-                clear_input_buffer();
-                if (choice != 'y' && choice != 'Y') {
-                    fclose(file);
-                    return;
-                }
-                // Continue to replace
-                break;
+    free(rows);
+
+    int ok = replace_data_file(out, dst - out);
+    if (ok) {
+        append_log(log_entries, log_size);
+    }
+    close_data_view(&view);
+    free(out);
+    free(log_entries);
+    if (!ok) {
+        printf("Error: Unable to save data\n");
+        return 0;
+    }
+    rebuild_summary();
+    invalidate_status();
+
+    double elapsed = seconds_since(&started);
+    printf("✓ Imported %zu day(s): %zu new, %zu replaced (%.1f ms, %.0f rows/s)\n",
+           added + replaced, added, replaced, elapsed * 1000,
+           elapsed > 0 ? count / elapsed : 0.0);
+    return 1;
+}
+
+// Value of an option given as "--name value" or "--name=value"
+const char *option_value(int argc, char *argv[], int *i, const char *name) {
+    size_t len = strlen(name);
+    if (strncmp(argv[*i], name, len) != 0) {
+        return NULL;
+    }
+    if (argv[*i][len] == '=') {
+        return argv[*i] + len + 1;
+    }
+    if (argv[*i][len] == '\0' && *i + 1 < argc) {
+        return argv[++*i];
+    }
+    return NULL;
+}
+
+typedef enum {
+    EXPORT_CSV,
+    EXPORT_JSON,
+    EXPORT_NDJSON
+} ExportFormat;
+
+void export_json_day(OutBuf *out, const WorkDay *day) {
+    out_str(out, "{\"date\":\"");
+    out_date(out, day->date);
+    out_str(out, "\",\"arrival\":\"");
+    out_punch(out, day->punches[0]);
+    out_str(out, "\",\"breaks\":[");
+    for (int i = 2; i < day->punch_count; i += 2) {
+        out_str(out, i > 2 ? ",{\"start\":\"" : "{\"start\":\"");
+        out_punch(out, day->punches[i - 1]);
+        out_str(out, "\",\"end\":\"");
+        out_punch(out, day->punches[i]);
+        out_str(out, "\"}");
+    }
+    out_str(out, "],\"departure\":\"");
+    out_punch(out, day->punches[day->punch_count - 1]);
+    out_str(out, "\",\"worked_minutes\":");
+    out_int(out, day->worked_minutes);
+    out_str(out, ",\"excess_minutes\":");
+    out_int(out, day->excess_minutes);
+    out_str(out, "}");
+}
+
+#define EXPORT_CSV_HEADER \
+    "date,arrival,lunch_start,lunch_end,departure,worked_minutes,excess_minutes,other_breaks\n"
+
+// One row with the columns of EXPORT_CSV_HEADER, the same for every day:
+// the first break goes in the lunch columns (empty without a break), the
+// others in other_breaks as HH:MM-HH:MM separated by spaces
+void export_csv_day(OutBuf *out, const WorkDay *day) {
+    out_date(out, day->date);
+    out_bytes(out, ",", 1);
+    out_punch(out, day->punches[0]);
+    out_bytes(out, ",", 1);
+    if (day->punch_count > 2) {
+        out_punch(out, day->punches[1]);
+        out_bytes(out, ",", 1);
+        out_punch(out, day->punches[2]);
+    } else {
+        out_bytes(out, ",", 1);
+    }
+    out_bytes(out, ",", 1);
+    out_punch(out, day->punches[day->punch_count - 1]);
+    out_bytes(out, ",", 1);
+    out_int(out, day->worked_minutes);
+    out_bytes(out, ",", 1);
+    out_int(out, day->excess_minutes);
+    out_bytes(out, ",", 1);
+    for (int i = 3; i + 1 < day->punch_count - 1; i += 2) {
+        if (i > 3) {
+            out_bytes(out, " ", 1);
+        }
+        out_punch(out, day->punches[i]);
+        out_bytes(out, "-", 1);
+        out_punch(out, day->punches[i + 1]);
+    }
+    out_bytes(out, "\n", 1);
+}
+
+// Write the days of a view between from and to (inclusive). Records are
+// read straight from the mapping and pages already written are dropped,
+// so memory use stays flat whatever the size of the history.
+void export_view(OutBuf *out, const DataView *view, ExportFormat format, int from, int to) {
+    int found;
+    size_t first = find_day(view, from, &found);
+    size_t last = to == INT32_MAX ? view->count : find_day(view, to + 1, &found);
+
+    if (format == EXPORT_CSV) {
+        out_str(out, EXPORT_CSV_HEADER);
+    } else if (format == EXPORT_JSON) {
+        out_str(out, "[");
+    }
+
+    const size_t page = sysconf(_SC_PAGESIZE);
+    size_t released = 0;
+    size_t i = first;
+    while (i < last && !out->failed) {
+        WorkDay day;
+        size_t records = read_day(view, i, &day);
+
+        if (format == EXPORT_CSV) {
+            export_csv_day(out, &day);
+        } else {
+            if (format == EXPORT_JSON && i > first) {
+                out_bytes(out, ",", 1);
+            }
+            if (format == EXPORT_JSON) {
+                out_bytes(out, "\n  ", 3);
+            }
+            export_json_day(out, &day);
+            if (format == EXPORT_NDJSON) {
+                out_bytes(out, "\n", 1);
             }
         }
-        fclose(file);
+
+        // Give back the mapped pages every megabyte or so
+        i += records;
+        size_t done = (HEADER_SIZE + i * RECORD_SIZE) & ~(page - 1);
+        if (view->map && done - released >= (1 << 20)) {
+            madvise((char *)view->map + released, done - released, MADV_DONTNEED);
+            released = done;
+        }
     }
-    
-    printf("\nEntering times for %s:\n\n", day.date);
-    
-    // Arrival time
-    printf("Arrival time (HH:MM): ");
-    if (scanf("%d:%d", &day.start_hour, &day.start_min) != 2) {
-        clear_input_buffer();
-        printf("Invalid format\n");
-        return;
+
+    if (format == EXPORT_JSON) {
+        out_str(out, last > first ? "\n]\n" : "]\n");
     }
-    clear_input_buffer();
-    
-    // Lunch start
-    printf("Lunch break start (HH:MM): ");
-    if (scanf("%d:%d", &day.lunch_start_hour, &day.lunch_start_min) != 2) {
-        clear_input_buffer();
-        printf("Invalid format\n");
-        return;
+}
+
+// Stream the days between from and to (inclusive) to fd
+int export_days(int fd, ExportFormat format, int from, int to) {
+    DataView view;
+    if (!open_history(&view)) {
+        return 0;
     }
-    clear_input_buffer();
-    
-    // Lunch end
-    printf("Lunch break end (HH:MM): ");
-    if (scanf("%d:%d", &day.lunch_end_hour, &day.lunch_end_min) != 2) {
-        clear_input_buffer();
-        printf("Invalid format\n");
-        return;
+    OutBuf out = {.fd = fd};
+    export_view(&out, &view, format, from, to);
+    out_flush(&out);
+    close_data_view(&view);
+    return !out.failed;
+}
+
+int run_export(int argc, char *argv[]) {
+    ExportFormat format = EXPORT_CSV;
+    int from = INT32_MIN, to = INT32_MAX;
+
+    for (int i = 2; i < argc; i++) {
+        const char *value;
+        if ((value = option_value(argc, argv, &i, "--format"))) {
+            if (strcmp(value, "csv") == 0) {
+                format = EXPORT_CSV;
+            } else if (strcmp(value, "json") == 0) {
+                format = EXPORT_JSON;
+            } else if (strcmp(value, "ndjson") == 0) {
+                format = EXPORT_NDJSON;
+            } else {
+                printf("Unknown format: %s (use csv, json or ndjson)\n", value);
+                return 1;
+            }
+        } else if ((value = option_value(argc, argv, &i, "--from"))) {
+            if (!parse_date(value, &from)) {
+                printf("Invalid date: %s\n", value);
+                return 1;
+            }
+        } else if ((value = option_value(argc, argv, &i, "--to"))) {
+            if (!parse_date(value, &to)) {
+                printf("Invalid date: %s\n", value);
+                return 1;
+            }
+        } else {
+            printf("Usage: worktracker export [--format csv|json|ndjson] [--from YYYY-MM-DD] [--to YYYY-MM-DD]\n");
+            return 1;
+        }
     }
-    clear_input_buffer();
-    
-    // Departure time
-    printf("Departure time (HH:MM): ");
-    if (scanf("%d:%d", &day.end_hour, &day.end_min) != 2) {
-        clear_input_buffer();
-        printf("Invalid format\n");
-        return;
+
+    fflush(stdout);
+    return export_days(STDOUT_FILENO, format, from, to) ? 0 : 1;
+}
+
+typedef enum {
+    REPORT_WEEK,
+    REPORT_MONTH,
+    REPORT_QUARTER,
+    REPORT_YEAR
+} ReportPeriod;
+
+typedef struct {
+    int key;
+    int days;
+    long long worked;
+    long long excess;
+    long long arrival;
+    long long departure;
+    long long breaks;
+} ReportBucket;
+
+// Bucket key of a day: the Monday of its week, or a month/quarter/year index
+int period_key(ReportPeriod period, int date) {
+    if (period == REPORT_WEEK) {
+        return date - weekday_of(date);
     }
-    clear_input_buffer();
-    
-    // Calculate worked minutes
-    int start_minutes = time_to_minutes(day.start_hour, day.start_min);
-    int lunch_start_minutes = time_to_minutes(day.lunch_start_hour, day.lunch_start_min);
-    int lunch_end_minutes = time_to_minutes(day.lunch_end_hour, day.lunch_end_min);
-    int end_minutes = time_to_minutes(day.end_hour, day.end_min);
-    
-    int morning_work = lunch_start_minutes - start_minutes;
-    int afternoon_work = end_minutes - lunch_end_minutes;
-    day.worked_minutes = morning_work + afternoon_work;
-    
-    int required_minutes = REQUIRED_HOURS * 60 + REQUIRED_MINUTES;
-    day.excess_minutes = day.worked_minutes - required_minutes;
-    
-    day.state = STATE_COMPLETED;
-    
-    // Save - insert at the right place to keep chronological order
-    // Load all entries
-    FILE *read_file = fopen(data_file_path, "rb");
-    WorkDay *entries = NULL;
-    int count = 0;
-    int capacity = 10;
-    
-    if (read_file) {
-        entries = malloc(capacity * sizeof(WorkDay));
-        WorkDay temp;
-        while (fread(&temp, sizeof(WorkDay), 1, read_file) == 1) {
-            // Don't copy entry if we're replacing it
-            if (strcmp(temp.date, day.date) != 0) {
-                if (count >= capacity) {
-                    capacity *= 2;
-                    entries = realloc(entries, capacity * sizeof(WorkDay));
-                }
-                entries[count++] = temp;
+    int month = month_of(date);
+    if (period == REPORT_MONTH) {
+        return month;
+    }
+    int year = month / 12;
+    if (period == REPORT_QUARTER) {
+        return year * 4 + (month - year * 12) / 3;
+    }
+    return year;
+}
+
+// Label of a bucket: 2026-W03, 2026-01, 2026-Q1 or 2026
+int out_period(OutBuf *out, ReportPeriod period, int key) {
+    char text[16];
+    int len;
+    if (period == REPORT_WEEK) {
+        // ISO week: the week belongs to the year of its Thursday
+        int thursday = key + 3;
+        int year, month, mday;
+        civil_from_days(thursday, &year, &month, &mday);
+        int week = (thursday - days_from_civil(year, 1, 1)) / 7 + 1;
+        len = snprintf(text, sizeof(text), "%04d-W%02d", year, week);
+    } else if (period == REPORT_MONTH) {
+        int year = key / 12;
+        len = snprintf(text, sizeof(text), "%04d-%02d", year, key - year * 12 + 1);
+    } else if (period == REPORT_QUARTER) {
+        int year = key / 4;
+        len = snprintf(text, sizeof(text), "%04d-Q%d", year, key - year * 4 + 1);
+    } else {
+        len = snprintf(text, sizeof(text), "%04d", key);
+    }
+    out_bytes(out, text, len);
+    return len;
+}
+
+void out_report_row(OutBuf *out, const ReportBucket *bucket) {
+    out_int_width(out, bucket->days, 6);
+    out_str(out, " | ");
+    out_spaces(out, 9 - out_duration(out, bucket->worked));
+    out_str(out, " | ");
+    out_spaces(out, 9 - out_time_diff(out, bucket->excess));
+    out_str(out, " | ");
+    out_clock(out, bucket->arrival / bucket->days);
+    out_str(out, "       | ");
+    out_spaces(out, 14 - out_punch(out, bucket->departure / bucket->days));
+    out_str(out, "| ");
+    out_duration(out, bucket->breaks / bucket->days);
+    out_str(out, "\n");
+}
+
+void out_report_bucket(OutBuf *out, ReportPeriod period, const ReportBucket *bucket) {
+    out_spaces(out, 8 - out_period(out, period, bucket->key));
+    out_str(out, " |");
+    out_report_row(out, bucket);
+}
+
+void report_add(ReportBucket *bucket, const DayBatch *batch, size_t k) {
+    bucket->days++;
+    bucket->worked += batch->worked[k];
+    bucket->excess += batch->excess[k];
+    bucket->arrival += batch->arrival[k];
+    bucket->departure += batch->departure[k];
+    bucket->breaks += batch->breaks[k];
+}
+
+// Totals and averages per week, month, quarter or year between from and
+// to, in one pass over the sorted records of a view starting at the
+// first day of the range
+void report_view(OutBuf *out, const DataView *view, ReportPeriod period, int from, int to) {
+    int found;
+    size_t first = find_day(view, from, &found);
+    size_t last = to == INT32_MAX ? view->count : find_day(view, to + 1, &found);
+
+    out_str(out, "Period   |  Days | Worked    | Excess    | Avg arrival | Avg departure | Avg breaks\n");
+    out_str(out, "=====================================================================================\n");
+
+    DayBatch batch = {0};
+    ReportBucket bucket = {0}, total = {0};
+    size_t i = first;
+    while (i < last) {
+        i += read_days(view, i, last, &batch);
+        compute_days(&batch);
+        for (size_t k = 0; k < batch.count; k++) {
+            int key = period_key(period, batch.date[k]);
+            // Close the current bucket when its period ends
+            if (bucket.days > 0 && key != bucket.key) {
+                out_report_bucket(out, period, &bucket);
+                bucket = (ReportBucket){0};
             }
+            bucket.key = key;
+            report_add(&bucket, &batch, k);
+            report_add(&total, &batch, k);
         }
-        fclose(read_file);
+    }
+    if (bucket.days > 0) {
+        out_report_bucket(out, period, &bucket);
+    }
+
+    out_str(out, "=====================================================================================\n");
+    if (total.days > 0) {
+        out_str(out, "Total    |");
+        out_report_row(out, &total);
     } else {
-        entries = malloc(capacity * sizeof(WorkDay));
+        out_str(out, "No days recorded in this range.\n");
     }
-    
-    // Insert new entry at the right place (chronological order)
-    int insert_pos = count;
-    for (int i = 0; i < count; i++) {
-        if (strcmp(day.date, entries[i].date) < 0) {
-            insert_pos = i;
-            break;
+}
+
+int show_report(int fd, ReportPeriod period, int from, int to) {
+    DataView view;
+    if (!open_history(&view)) {
+        return 0;
+    }
+    fflush(stdout);
+    OutBuf out = {.fd = fd};
+    report_view(&out, &view, period, from, to);
+    out_flush(&out);
+    close_data_view(&view);
+    return !out.failed;
+}
+
+int parse_period(const char *name, ReportPeriod *period) {
+    static const char *names[] = {"week", "month", "quarter", "year"};
+    static const ReportPeriod periods[] = {REPORT_WEEK, REPORT_MONTH, REPORT_QUARTER, REPORT_YEAR};
+    for (int i = 0; i < 4; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *period = periods[i];
+            return 1;
         }
     }
-    
-    // Shift entries if needed
-    if (count >= capacity) {
-        capacity++;
-        entries = realloc(entries, capacity * sizeof(WorkDay));
+    return 0;
+}
+
+int run_report(int argc, char *argv[]) {
+    ReportPeriod period = REPORT_MONTH;
+    int from = INT32_MIN, to = INT32_MAX;
+
+    for (int i = 2; i < argc; i++) {
+        const char *value;
+        if ((value = option_value(argc, argv, &i, "--by"))) {
+            if (!parse_period(value, &period)) {
+                printf("Unknown period: %s (use week, month, quarter or year)\n", value);
+                return 1;
+            }
+        } else if ((value = option_value(argc, argv, &i, "--from"))) {
+            if (!parse_date(value, &from)) {
+                printf("Invalid date: %s\n", value);
+                return 1;
+            }
+        } else if ((value = option_value(argc, argv, &i, "--to"))) {
+            if (!parse_date(value, &to)) {
+                printf("Invalid date: %s\n", value);
+                return 1;
+            }
+        } else {
+            printf("Usage: worktracker report [--by week|month|quarter|year] [--from YYYY-MM-DD] [--to YYYY-MM-DD]\n");
+            return 1;
+        }
     }
-    
-    for (int i = count; i > insert_pos; i--) {
-        entries[i] = entries[i-1];
+
+    return show_report(STDOUT_FILENO, period, from, to) ? 0 : 1;
+}
+
+// Totals of the current data directory. Unlike open_data_view(), a
+// current cache means the records are not read at all.
+int load_current_summary(Summary *summary) {
+    *summary = (Summary){0};
+    int fd = open_locked_data_file(O_RDONLY, F_RDLCK, 0);
+    if (fd < 0) {
+        return 0;
     }
-    entries[insert_pos] = day;
-    count++;
-    
-    // Rewrite file
-    FILE *write_file = fopen(data_file_path, "wb");
-    if (write_file) {
-        fwrite(entries, sizeof(WorkDay), count, write_file);
-        fclose(write_file);
-        
-        printf("\n✓ Day %s saved!\n", day.date);
-        printf("===========================================\n");
-        printf("Arrival:         %02d:%02d\n", day.start_hour, day.start_min);
-        printf("Lunch break:     %02d:%02d - %02d:%02d\n", 
-               day.lunch_start_hour, day.lunch_start_min,
-               day.lunch_end_hour, day.lunch_end_min);
-        printf("Departure:       %02d:%02d\n", day.end_hour, day.end_min);
-        printf("-------------------------------------------\n");
-        printf("Time worked:     %02d:%02d\n", day.worked_minutes / 60, day.worked_minutes % 60);
-        printf("Required:        %02d:%02d\n", REQUIRED_HOURS, REQUIRED_MINUTES);
-        printf("Difference:      ");
-        print_time_diff(day.excess_minutes);
-        printf("\n===========================================\n");
-    } else {
-        printf("Error: Unable to save data\n");
+
+    DataView view;
+    int ok = map_data_view(fd, &view);
+    view.fd = fd;
+    if (ok) {
+        get_summary(summary, &view);
     }
-    
-    free(entries);
+    close_data_view(&view);
+    return ok;
 }
 
-void modify_entry() {
-    FILE *file = fopen(data_file_path, "rb");
-    if (!file) {
-        printf("\nNo history found.\n");
+// Add up the cached monthly totals of every user of the store, for the
+// month indexes from..to. Each user costs one small cache read, whatever
+// the length of their history.
+int show_team(int from, int to) {
+    char users_path[600];
+    snprintf(users_path, sizeof(users_path), "%s/%s", store_path, STORE_USERS_DIR);
+    DIR *dir = opendir(users_path);
+    if (!dir) {
+        printf("Error: Unable to read %s\n", users_path);
+        return 0;
+    }
+
+    Summary team = {0};
+    int users = 0, unreadable = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!valid_user_name(entry->d_name)) {
+            continue;
+        }
+        char user_dir[900];
+        snprintf(user_dir, sizeof(user_dir), "%s/%s", users_path, entry->d_name);
+        set_data_dir(user_dir);
+
+        // A partition without a data file has nothing to count, but one
+        // that cannot be read must not pass for an empty one
+        struct stat st;
+        if (stat(data_file_path, &st) != 0 && errno == ENOENT) {
+            continue;
+        }
+        Summary summary;
+        if (!load_current_summary(&summary)) {
+            printf("⚠️  Unable to read the data of %s, not counted\n", entry->d_name);
+            unreadable++;
+            continue;
+        }
+        int counted = 0;
+        for (size_t i = 0; i < summary.count; i++) {
+            const MonthTotals *month = &summary.months[i];
+            if (month->month < from || month->month > to) {
+                continue;
+            }
+            MonthTotals *totals = summary_month(&team, month->month);
+            if (!totals) {
+                continue;
+            }
+            totals->days += month->days;
+            totals->worked += month->worked;
+            totals->excess += month->excess;
+            team.days += month->days;
+            team.worked += month->worked;
+            team.excess += month->excess;
+            counted = 1;
+        }
+        users += counted;
+        free_summary(&summary);
+    }
+    closedir(dir);
+
+    OutBuf out = {.fd = STDOUT_FILENO};
+    out_str(&out, "Team: ");
+    out_int(&out, users);
+    out_str(&out, users == 1 ? " user" : " users");
+    if (unreadable) {
+        out_str(&out, " (");
+        out_int(&out, unreadable);
+        out_str(&out, " unreadable)");
+    }
+    out_str(&out, "\n\n");
+    render_summary(&out, &team);
+    fflush(stdout);
+    out_flush(&out);
+    free_summary(&team);
+    return !out.failed && !unreadable;
+}
+
+int run_team(int argc, char *argv[]) {
+    int from = INT32_MIN, to = INT32_MAX;
+
+    for (int i = 2; i < argc; i++) {
+        const char *value;
+        if ((value = option_value(argc, argv, &i, "--from"))) {
+            if (!parse_date(value, &from)) {
+                printf("Invalid date: %s\n", value);
+                return 1;
+            }
+        } else if ((value = option_value(argc, argv, &i, "--to"))) {
+            if (!parse_date(value, &to)) {
+                printf("Invalid date: %s\n", value);
+                return 1;
+            }
+        } else {
+            printf("Usage: worktracker team [--from YYYY-MM-DD] [--to YYYY-MM-DD]\n");
+            return 1;
+        }
+    }
+
+    if (!store_path[0]) {
+        printf("Error: Team totals need a shared store (--store DIR or WORKTRACKER_STORE)\n");
+        return 1;
+    }
+    return show_team(from == INT32_MIN ? INT32_MIN : month_of(from),
+                     to == INT32_MAX ? INT32_MAX : month_of(to)) ? 0 : 1;
+}
+
+// Daemon mode: keeps today's day, the totals and a copy of the records in
+// memory and answers one-line requests on a Unix socket next to the data
+// file. Each request gets one line starting with "OK" or "ERR"; history
+// and report send their lines first and end with a line holding only ".".
+// Clients are non-blocking: a reply waits in the client's queue until it
+// can be sent, and the client's next request waits for it, so a client
+// that stops reading holds up nobody else.
+//   ping | status | totals | punch in|lunch|back|out [HH:MM]
+//   | history [FROM [TO]] | report [week|month|quarter|year] | quit
+#define DAEMON_MAX_CLIENTS 64
+
+typedef struct {
+    int fd;
+    size_t len;
+    char buf[256];
+    OutQueue out;  // replies not sent yet
+} DaemonClient;
+
+typedef struct {
+    WorkDay day;       // today's day, state STATE_NEW before the first punch
+    struct stat temp;  // in-progress and data files as last read
+    struct stat day_data;
+    int dirty;         // day changed and not saved yet
+    Summary summary;
+    int loaded;        // summary holds the totals
+    DataView history;  // records copied to the heap (map and fd unused)
+    int history_loaded;
+    int lock;          // lock_temp_day() from a punch until it is saved, or -1
+} DaemonState;
+
+volatile sig_atomic_t daemon_stop = 0;
+
+void daemon_signal(int signum) {
+    (void)signum;
+    daemon_stop = 1;
+}
+
+int same_file_state(const struct stat *a, const struct stat *b) {
+    return a->st_ino == b->st_ino && a->st_size == b->st_size &&
+           a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+// Reload today's day only if another process changed its files
+void daemon_refresh_day(DaemonState *state) {
+    int today = get_current_date();
+    // A night shift from yesterday stays loaded while it is running
+    if (state->dirty && state->day.date >= today - 1) {
         return;
     }
-    
-    // Load all entries
-    WorkDay *entries = NULL;
-    int count = 0;
-    int capacity = 10;
-    entries = malloc(capacity * sizeof(WorkDay));
-    
-    WorkDay temp;
-    while (fread(&temp, sizeof(WorkDay), 1, file) == 1) {
-        if (count >= capacity) {
-            capacity *= 2;
-            entries = realloc(entries, capacity * sizeof(WorkDay));
+
+    struct stat temp = {0}, data = {0};
+    stat(temp_file_path, &temp);
+    stat(data_file_path, &data);
+    if (state->day.date == today && same_file_state(&temp, &state->temp) &&
+        same_file_state(&data, &state->day_data)) {
+        return;
+    }
+
+    state->temp = temp;
+    state->day_data = data;
+    state->dirty = 0;
+    if (!temp.st_ino || !load_temp_day(&state->day)) {
+        // A day completed today cannot be punched again
+        if (!day_recorded(today, &state->day)) {
+            state->day = (WorkDay){.date = today, .state = STATE_NEW};
         }
-        entries[count++] = temp;
     }
-    fclose(file);
-    
-    if (count == 0) {
-        printf("\nNo entries to modify.\n");
-        free(entries);
+}
+
+// Generation and id in the data file header, which change with it
+void read_data_file_state(uint32_t *generation, uint32_t *file_id) {
+    unsigned char fields[8] = {0};
+    int fd = open(data_file_path, O_RDONLY);
+    if (fd >= 0) {
+        pread(fd, fields, sizeof(fields), 8);
+        close(fd);
+    }
+    *generation = get_u32(fields);
+    *file_id = get_u32(fields + 4);
+}
+
+// Reread the totals when the data file changed
+void daemon_refresh_summary(DaemonState *state) {
+    uint32_t generation, file_id;
+    read_data_file_state(&generation, &file_id);
+    if (state->loaded && generation == state->summary.generation && file_id == state->summary.file_id) {
         return;
     }
-    
-    // Display all entries with numbers
-    printf("\n=== MODIFY ENTRY ===\n\n");
-    printf("Available entries:\n");
-    printf("========================================================================================================\n");
-    printf("ID | Date       | Start  | Lunch      | End    | Time worked | Difference\n");
-    printf("========================================================================================================\n");
-    
-    for (int i = 0; i < count; i++) {
-        printf("%2d | %s | %02d:%02d  | %02d:%02d-%02d:%02d | %02d:%02d  | %02d:%02d        | ",
-               i + 1,
-               entries[i].date,
-               entries[i].start_hour, entries[i].start_min,
-               entries[i].lunch_start_hour, entries[i].lunch_start_min,
-               entries[i].lunch_end_hour, entries[i].lunch_end_min,
-               entries[i].end_hour, entries[i].end_min,
-               entries[i].worked_minutes / 60, entries[i].worked_minutes % 60);
-        print_time_diff(entries[i].excess_minutes);
-        printf("\n");
+    free_summary(&state->summary);
+    load_current_summary(&state->summary);
+    state->loaded = 1;
+}
+
+// Copy the records again when the data file changed. Returns 0 if it
+// cannot be read.
+int daemon_refresh_history(DaemonState *state) {
+    uint32_t generation, file_id;
+    read_data_file_state(&generation, &file_id);
+    if (state->history_loaded && generation == state->history.generation &&
+        file_id == state->history.file_id) {
+        return 1;
     }
-    printf("========================================================================================================\n");
-    
-    // Ask which entry to modify
-    printf("\nEnter the ID of the entry to modify (or 0 to cancel): ");
-    int id;
-    if (scanf("%d", &id) != 1) {
-        clear_input_buffer();
-        printf("Invalid input\n");
-        free(entries);
+
+    DataView view;
+    if (!open_history(&view)) {
+        return 0;
+    }
+    unsigned char *records = malloc(view.count * RECORD_SIZE + 1);
+    if (!records) {
+        close_data_view(&view);
+        return 0;
+    }
+    if (view.count > 0) {
+        memcpy(records, view.records, view.count * RECORD_SIZE);
+    }
+    free((void *)state->history.records);
+    state->history = (DataView){.fd = -1, .records = records, .count = view.count,
+                                .generation = view.generation, .file_id = view.file_id,
+                                .checksum = view.checksum};
+    state->history_loaded = 1;
+    close_data_view(&view);
+    return 1;
+}
+
+void daemon_reply_status(OutBuf *out, DaemonState *state) {
+    daemon_refresh_day(state);
+    DayStatus status;
+    day_status(&state->day, minutes_since(state->day.date), &status);
+
+    out_str(out, "OK state=");
+    out_str(out, state_names[status.state]);
+    out_str(out, " date=");
+    out_date(out, state->day.date);
+    out_str(out, " worked=");
+    out_clock(out, status.worked);
+    out_str(out, " end=");
+    if (status.expected_end >= 0) {
+        out_punch(out, status.expected_end);
+    } else {
+        out_str(out, "-");
+    }
+    out_str(out, "\n");
+}
+
+void daemon_reply_punch(OutBuf *out, DaemonState *state, char *args) {
+    char *name = strtok(args, " ");
+    char *when = strtok(NULL, " ");
+    PunchKind kind;
+    int minutes;
+    if (!name || !parse_punch(name, &kind)) {
+        out_str(out, "ERR usage: punch in|lunch|back|out [HH:MM]\n");
         return;
     }
-    clear_input_buffer();
-    
-    if (id == 0) {
-        free(entries);
+    if (when && !parse_punch_time(when, &minutes)) {
+        out_str(out, "ERR invalid time\n");
+        return;
+    }
+
+    if (state->lock < 0 && (state->lock = lock_temp_day()) < 0) {
+        out_str(out, "ERR unable to lock the day in progress\n");
+        return;
+    }
+    daemon_refresh_day(state);
+    if (!when) {
+        minutes = minutes_since(state->day.date);
+    }
+    const char *error = apply_punch(&state->day, kind, minutes);
+    if (error) {
+        if (!state->dirty) {
+            close(state->lock);
+            state->lock = -1;
+        }
+        out_str(out, "ERR ");
+        out_str(out, error);
+        out_str(out, "\n");
+        return;
+    }
+    // Saved after the reply is sent
+    state->dirty = 1;
+
+    out_str(out, "OK state=");
+    out_str(out, state_names[state->day.state]);
+    out_str(out, " time=");
+    out_punch(out, state->day.punches[state->day.punch_count - 1]);
+    if (state->day.state == STATE_COMPLETED) {
+        out_str(out, " worked=");
+        out_clock(out, state->day.worked_minutes);
+        out_str(out, " excess=");
+        out_time_diff(out, state->day.excess_minutes);
+    }
+    out_str(out, "\n");
+}
+
+void daemon_reply_totals(OutBuf *out, DaemonState *state) {
+    daemon_refresh_summary(state);
+    out_str(out, "OK days=");
+    out_int(out, state->summary.days);
+    out_str(out, " worked=");
+    out_duration(out, state->summary.worked);
+    out_str(out, " excess=");
+    out_time_diff(out, state->summary.excess);
+    out_str(out, "\n");
+}
+
+// Handle one request line, queueing the reply. Returns 0 when the client
+// asked to quit or the reply does not fit in memory.
+int daemon_request(OutQueue *queue, DaemonState *state, char *line) {
+    OutBuf out = {.fd = -1, .queue = queue};
+    char *command = strtok(line, " ");
+    char *args = strtok(NULL, "");
+    if (!command) {
+        return 1;
+    }
+
+    if (strcmp(command, "ping") == 0) {
+        out_str(&out, "OK\n");
+    } else if (strcmp(command, "status") == 0) {
+        daemon_reply_status(&out, state);
+    } else if (strcmp(command, "punch") == 0) {
+        daemon_reply_punch(&out, state, args ? args : "");
+    } else if (strcmp(command, "totals") == 0) {
+        daemon_reply_totals(&out, state);
+    } else if (strcmp(command, "history") == 0) {
+        char *from_text = args ? strtok(args, " ") : NULL;
+        char *to_text = from_text ? strtok(NULL, " ") : NULL;
+        int from = INT32_MIN, to = INT32_MAX;
+        if ((from_text && !parse_date(from_text, &from)) || (to_text && !parse_date(to_text, &to))) {
+            out_str(&out, "ERR invalid date\n");
+        } else if (!daemon_refresh_history(state)) {
+            out_str(&out, "ERR unable to read the history\n");
+        } else {
+            export_view(&out, &state->history, EXPORT_CSV, from, to);
+            out_str(&out, ".\n");
+        }
+    } else if (strcmp(command, "report") == 0) {
+        ReportPeriod period = REPORT_MONTH;
+        if (args && !parse_period(args, &period)) {
+            out_str(&out, "ERR unknown period\n");
+        } else if (!daemon_refresh_history(state)) {
+            out_str(&out, "ERR unable to read the history\n");
+        } else {
+            report_view(&out, &state->history, period, INT32_MIN, INT32_MAX);
+            out_str(&out, ".\n");
+        }
+    } else if (strcmp(command, "quit") == 0) {
+        return 0;
+    } else {
+        out_str(&out, "ERR unknown request\n");
+    }
+    out_flush(&out);
+    return !out.failed;
+}
+
+// Write a punched day out and unlock it. On failure it stays dirty and
+// locked, and is retried.
+void daemon_save(DaemonState *state) {
+    if (!state->dirty) {
+        return;
+    }
+    if (!save_punch(&state->day)) {
+        fprintf(stderr, "worktracker: unable to save the day, will retry\n");
         return;
     }
-    
-    if (id < 1 || id > count) {
-        printf("Invalid ID\n");
-        free(entries);
-        return;
+    state->dirty = 0;
+    stat(temp_file_path, &state->temp);
+    stat(data_file_path, &state->day_data);
+    close(state->lock);
+    state->lock = -1;
+}
+
+// Send what the client's queue holds without blocking. Returns 0 when the
+// connection is gone.
+int daemon_send(DaemonClient *client) {
+    OutQueue *queue = &client->out;
+    while (queue->sent < queue->len) {
+        ssize_t n = write(client->fd, queue->data + queue->sent, queue->len - queue->sent);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return 1;
+        }
+        if (n <= 0) {
+            return 0;
+        }
+        queue->sent += n;
+    }
+    queue->len = 0;
+    queue->sent = 0;
+    return 1;
+}
+
+int run_daemon() {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socket_file_path) >= sizeof(addr.sun_path)) {
+        printf("Error: Socket path is too long: %s\n", socket_file_path);
+        return 1;
+    }
+    memcpy(addr.sun_path, socket_file_path, strlen(socket_file_path) + 1);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        printf("Error: Unable to create a socket\n");
+        return 1;
+    }
+
+    // A socket file nobody answers on is left over from a stopped daemon
+    if (connect(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        printf("Error: A daemon is already running on %s\n", socket_file_path);
+        close(listener);
+        return 1;
     }
-    
-    int index = id - 1;
-    WorkDay *day = &entries[index];
-    
-    printf("\n=== MODIFYING: %s ===\n", day->date);
-    printf("Current values:\n");
-    printf("  Arrival:     %02d:%02d\n", day->start_hour, day->start_min);
-    printf("  Lunch start: %02d:%02d\n", day->lunch_start_hour, day->lunch_start_min);
-    printf("  Lunch end:   %02d:%02d\n", day->lunch_end_hour, day->lunch_end_min);
-    printf("  Departure:   %02d:%02d\n", day->end_hour, day->end_min);
-    printf("\n");
-    
-    // Menu for what to modify
-    printf("What do you want to modify?\n");
-    printf("1. Arrival time\n");
-    printf("2. Lunch break start\n");
-    printf("3. Lunch break end\n");
-    printf("4. Departure time\n");
-    printf("5. Modify all times\n");
-    printf("6. Delete this entry\n");
-    printf("0. Cancel\n");
-    printf("\nChoice: ");
-    
-    int choice;
-    if (scanf("%d", &choice) != 1) {
-        clear_input_buffer();
-        printf("Invalid input\n");
-        free(entries);
-        return;
+    unlink(socket_file_path);
+
+    mode_t mask = umask(077);
+    int bound = bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    umask(mask);
+    if (!bound || listen(listener, 16) < 0) {
+        printf("Error: Unable to listen on %s\n", socket_file_path);
+        close(listener);
+        return 1;
     }
-    clear_input_buffer();
-    
-    switch (choice) {
-        case 0:
-            free(entries);
-            return;
-            
-        case 1:
-            printf("\nNew arrival time (HH:MM): ");
-            if (scanf("%d:%d", &day->start_hour, &day->start_min) != 2) {
-                clear_input_buffer();
-                printf("Invalid format\n");
-                free(entries);
-                return;
+
+    signal(SIGINT, daemon_signal);
+    signal(SIGTERM, daemon_signal);
+    signal(SIGPIPE, SIG_IGN);
+    printf("✓ Listening on %s\n", socket_file_path);
+    fflush(stdout);
+
+    DaemonState state = {.lock = -1};
+    DaemonClient clients[DAEMON_MAX_CLIENTS];
+    int client_count = 0;
+    struct pollfd fds[DAEMON_MAX_CLIENTS + 1];
+
+    while (!daemon_stop) {
+        fds[0] = (struct pollfd){.fd = listener, .events = POLLIN};
+        for (int i = 0; i < client_count; i++) {
+            int waiting = clients[i].out.sent < clients[i].out.len;
+            fds[i + 1] = (struct pollfd){.fd = clients[i].fd, .events = waiting ? POLLOUT : POLLIN};
+        }
+        // Wake up to retry a save that failed
+        if (poll(fds, client_count + 1, state.dirty ? 1000 : -1) < 0) {
+            continue;
+        }
+
+        for (int i = client_count - 1; i >= 0; i--) {
+            if (!fds[i + 1].revents) {
+                continue;
             }
-            clear_input_buffer();
-            break;
-            
-        case 2:
-            printf("\nNew lunch break start (HH:MM): ");
-            if (scanf("%d:%d", &day->lunch_start_hour, &day->lunch_start_min) != 2) {
-                clear_input_buffer();
-                printf("Invalid format\n");
-                free(entries);
-                return;
+            DaemonClient *client = &clients[i];
+            int open = 1;
+            if (fds[i + 1].events & POLLOUT) {
+                open = daemon_send(client);
+            } else {
+                ssize_t n = read(client->fd, client->buf + client->len, sizeof(client->buf) - client->len);
+                if (n > 0) {
+                    client->len += n;
+                } else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                    open = 0;
+                }
             }
-            clear_input_buffer();
-            break;
-            
-        case 3:
-            printf("\nNew lunch break end (HH:MM): ");
-            if (scanf("%d:%d", &day->lunch_end_hour, &day->lunch_end_min) != 2) {
-                clear_input_buffer();
-                printf("Invalid format\n");
-                free(entries);
-                return;
+
+            // Answer complete lines until a reply has to wait for the client
+            char *newline;
+            while (open && client->out.len == 0 &&
+                   (newline = memchr(client->buf, '\n', client->len)) != NULL) {
+                *newline = '\0';
+                if (newline > client->buf && newline[-1] == '\r') {
+                    newline[-1] = '\0';
+                }
+                int more = daemon_request(&client->out, &state, client->buf);
+                open = daemon_send(client) && more;
+                // The reply is on its way, now the punch reaches the disk
+                daemon_save(&state);
+                size_t used = newline + 1 - client->buf;
+                memmove(client->buf, newline + 1, client->len - used);
+                client->len -= used;
             }
-            clear_input_buffer();
-            break;
-            
-        case 4:
-            printf("\nNew departure time (HH:MM): ");
-            if (scanf("%d:%d", &day->end_hour, &day->end_min) != 2) {
-                clear_input_buffer();
-                printf("Invalid format\n");
-                free(entries);
-                return;
+            if (open && client->out.len == 0 && client->len == sizeof(client->buf)) {
+                queue_bytes(&client->out, "ERR request too long\n", 21);
+                daemon_send(client);
+                open = 0;
             }
-            clear_input_buffer();
-            break;
-            
-        case 5:
-            printf("\nNew arrival time (HH:MM): ");
-            if (scanf("%d:%d", &day->start_hour, &day->start_min) != 2) {
-                clear_input_buffer();
-                printf("Invalid format\n");
-                free(entries);
-                return;
+            if (!open) {
+                close(client->fd);
+                free(client->out.data);
+                clients[i] = clients[--client_count];
             }
-            clear_input_buffer();
-            
-            printf("New lunch break start (HH:MM): ");
-            if (scanf("%d:%d", &day->lunch_start_hour, &day->lunch_start_min) != 2) {
-                clear_input_buffer();
-                printf("Invalid format\n");
-                free(entries);
-                return;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd >= 0 && client_count < DAEMON_MAX_CLIENTS &&
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0) {
+                clients[client_count++] = (DaemonClient){.fd = fd};
+            } else if (fd >= 0) {
+                close(fd);
             }
-            clear_input_buffer();
-            
-            printf("New lunch break end (HH:MM): ");
-            if (scanf("%d:%d", &day->lunch_end_hour, &day->lunch_end_min) != 2) {
-                clear_input_buffer();
-                printf("Invalid format\n");
-                free(entries);
-                return;
+        }
+
+        daemon_save(&state);
+    }
+
+    daemon_save(&state);
+    for (int i = 0; i < client_count; i++) {
+        close(clients[i].fd);
+        free(clients[i].out.data);
+    }
+    close(listener);
+    unlink(socket_file_path);
+    free_summary(&state.summary);
+    free((void *)state.history.records);
+    printf("✓ Daemon stopped\n");
+    return 0;
+}
+
+void print_usage() {
+    printf("Usage: worktracker [--store DIR] [--user NAME] [command]\n");
+    printf("\n");
+    printf("Without a command, the interactive menu is started.\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  --store DIR      Use a shared store with one partition per user\n");
+    printf("                   (default: $WORKTRACKER_STORE, else ~/.local/bin)\n");
+    printf("  --user NAME      User whose days to use in the store\n");
+    printf("                   (default: $WORKTRACKER_USER, else the login name)\n");
+    printf("\n");
+    printf("Commands:\n");
+    printf("  punch in|lunch|back|out [HH:MM]\n");
+    printf("                   Record the next punch of today (now by default);\n");
+    printf("                   'break' is the same as 'lunch', for each further break\n");
+    printf("  status [--format short|json]\n");
+    printf("                   Today's state, time worked and expected end\n");
+    printf("  import FILE      Add days from a CSV file (- for stdin), one per line:\n");
+    printf("                   YYYY-MM-DD,arrival,break start,break end,...,departure\n");
+    printf("  export [--format csv|json|ndjson] [--from YYYY-MM-DD] [--to YYYY-MM-DD]\n");
+    printf("                   Write recorded days to stdout (CSV by default)\n");
+    printf("  report [--by week|month|quarter|year] [--from YYYY-MM-DD] [--to YYYY-MM-DD]\n");
+    printf("                   Totals and average times per period (month by default)\n");
+    printf("  balance          Show worked time and excess per month\n");
+    printf("  team [--from YYYY-MM-DD] [--to YYYY-MM-DD]\n");
+    printf("                   Monthly totals of every user of the store\n");
+    printf("  recompute [--all]\n");
+    printf("                   Recompute cached totals after a schedule change, or\n");
+    printf("                   those of every user of the store with --all\n");
+    printf("  undo, redo       Take back the last change of the data (a saved, modified\n");
+    printf("                   or deleted day, an import, a reset), or make it again\n");
+    printf("  restore YYYY-MM-DD HH:MM\n");
+    printf("                   Undo or redo changes to get the data as it was then\n");
+    printf("  log              List the last 20 changes\n");
+    printf("  snapshot [--dir DIR]\n");
+    printf("                   Back up the days changed since the last snapshot\n");
+    printf("                   (default DIR: snapshots/ next to the data file)\n");
+    printf("  compact [--dir DIR] [--output FILE]\n");
+    printf("                   Take a snapshot and merge all of them into one; FILE\n");
+    printf("                   gets the result as a data file, to restore from\n");
+    printf("  --daemon         Serve status, punches, totals, history and reports on a\n");
+    printf("                   Unix socket next to the data file (worktracker.sock)\n");
+    printf("  help             Show this help\n");
+}
+
+int run_snapshot(int argc, char *argv[]) {
+    int compact = strcmp(argv[1], "compact") == 0;
+    const char *output = NULL;
+    for (int i = 2; i < argc; i++) {
+        const char *value;
+        if ((value = option_value(argc, argv, &i, "--dir"))) {
+            snprintf(snapshot_dir_path, sizeof(snapshot_dir_path), "%s", value);
+        } else if (compact && (value = option_value(argc, argv, &i, "--output"))) {
+            output = value;
+        } else {
+            printf(compact ? "Usage: worktracker compact [--dir DIR] [--output FILE]\n"
+                           : "Usage: worktracker snapshot [--dir DIR]\n");
+            return 1;
+        }
+    }
+    return (compact ? compact_snapshots(output) : take_snapshot()) ? 0 : 1;
+}
+
+// Go back to the data as it was at a date and time, in local time
+int run_restore(int argc, char *argv[]) {
+    int date, minutes;
+    if (argc != 4 || !parse_date(argv[2], &date) || !parse_time(argv[3], &minutes)) {
+        printf("Usage: worktracker restore YYYY-MM-DD HH:MM\n");
+        return 1;
+    }
+    int year, month, mday;
+    civil_from_days(date, &year, &month, &mday);
+    struct tm tm = {0};
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month - 1;
+    tm.tm_mday = mday;
+    tm.tm_hour = minutes / 60;
+    tm.tm_min = minutes % 60;
+    tm.tm_isdst = -1;
+    return move_history(HISTORY_RESTORE, mktime(&tm)) ? 0 : 1;
+}
+
+// Recompute the cached totals after the schedule changed, for one user
+// or with --all for every user of the store, and report how fast
+int run_recompute(int argc, char *argv[]) {
+    int all = 0;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--all") == 0) {
+            all = 1;
+        } else {
+            printf("Usage: worktracker recompute [--all]\n");
+            return 1;
+        }
+    }
+    if (all && !store_path[0]) {
+        printf("Error: --all needs a shared store (--store DIR or WORKTRACKER_STORE)\n");
+        return 1;
+    }
+
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    int had_cache = 0;
+    long long before = 0, after = 0;
+    long days = 0;
+    int users = 0, failed = 0;
+
+    if (!all) {
+        struct stat st;
+        if (stat(data_file_path, &st) == 0) {
+            days = recompute_summary(&had_cache, &before, &after);
+            users = 1;
+        }
+        failed = days < 0;
+    } else {
+        char users_path[600];
+        snprintf(users_path, sizeof(users_path), "%s/%s", store_path, STORE_USERS_DIR);
+        DIR *dir = opendir(users_path);
+        if (!dir) {
+            printf("Error: Unable to read %s\n", users_path);
+            return 1;
+        }
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (!valid_user_name(entry->d_name)) {
+                continue;
             }
-            clear_input_buffer();
-            
-            printf("New departure time (HH:MM): ");
-            if (scanf("%d:%d", &day->end_hour, &day->end_min) != 2) {
-                clear_input_buffer();
-                printf("Invalid format\n");
-                free(entries);
-                return;
+            char user_dir[900];
+            snprintf(user_dir, sizeof(user_dir), "%s/%s", users_path, entry->d_name);
+            set_data_dir(user_dir);
+            struct stat st;
+            if (stat(data_file_path, &st) != 0) {
+                continue;
             }
-            clear_input_buffer();
-            break;
-            
-        case 6:
-            printf("\nAre you sure you want to delete this entry? (y/n): ");
-            char confirm;
-            scanf("%c", &confirm);
-            clear_input_buffer();
-            
-            if (confirm == 'y' || confirm == 'Y') {
-                // Remove entry from array
-                for (int i = index; i < count - 1; i++) {
-                    entries[i] = entries[i + 1];
-                }
-                count--;
-                
-                // Rewrite file
-                FILE *write_file = fopen(data_file_path, "wb");
-                if (write_file) {
-                    fwrite(entries, sizeof(WorkDay), count, write_file);
-                    fclose(write_file);
-                    printf("✓ Entry deleted.\n");
-                } else {
-                    printf("Error: Unable to save changes\n");
-                }
+            long user_days = recompute_summary(&had_cache, &before, &after);
+            if (user_days < 0) {
+                printf("Error: Unable to recompute the totals of %s\n", entry->d_name);
+                failed++;
+                continue;
             }
-            free(entries);
-            return;
-            
-        default:
-            printf("Invalid choice\n");
-            free(entries);
-            return;
+            invalidate_status();
+            days += user_days;
+            users++;
+        }
+        closedir(dir);
     }
-    
-    // Recalculate worked minutes and excess
-    int start_minutes = time_to_minutes(day->start_hour, day->start_min);
-    int lunch_start_minutes = time_to_minutes(day->lunch_start_hour, day->lunch_start_min);
-    int lunch_end_minutes = time_to_minutes(day->lunch_end_hour, day->lunch_end_min);
-    int end_minutes = time_to_minutes(day->end_hour, day->end_min);
-    
-    int morning_work = lunch_start_minutes - start_minutes;
-    int afternoon_work = end_minutes - lunch_end_minutes;
-    day->worked_minutes = morning_work + afternoon_work;
-    
-    int required_minutes = REQUIRED_HOURS * 60 + REQUIRED_MINUTES;
-    day->excess_minutes = day->worked_minutes - required_minutes;
-    
-    // Rewrite file with updated data
-    FILE *write_file = fopen(data_file_path, "wb");
-    if (write_file) {
-        fwrite(entries, sizeof(WorkDay), count, write_file);
-        fclose(write_file);
-        
-        printf("\n✓ Entry updated!\n");
-        printf("===========================================\n");
-        printf("Date:            %s\n", day->date);
-        printf("Arrival:         %02d:%02d\n", day->start_hour, day->start_min);
-        printf("Lunch break:     %02d:%02d - %02d:%02d\n", 
-               day->lunch_start_hour, day->lunch_start_min,
-               day->lunch_end_hour, day->lunch_end_min);
-        printf("Departure:       %02d:%02d\n", day->end_hour, day->end_min);
-        printf("-------------------------------------------\n");
-        printf("Time worked:     %02d:%02d\n", day->worked_minutes / 60, day->worked_minutes % 60);
-        printf("Required:        %02d:%02d\n", REQUIRED_HOURS, REQUIRED_MINUTES);
-        printf("Difference:      ");
-        print_time_diff(day->excess_minutes);
-        printf("\n===========================================\n");
-    } else {
-        printf("Error: Unable to save changes\n");
+    if (failed && !all) {
+        printf("Error: Unable to recompute the totals of %s\n", data_file_path);
+        return 1;
     }
-    
-    free(entries);
+    if (!all) {
+        invalidate_status();
+    }
+
+    double elapsed = seconds_since(&started);
+    printf("✓ Recomputed %ld day(s)", days);
+    if (all) {
+        printf(" of %d user(s)", users);
+    }
+    printf(" (%.1f ms, %.0f days/s)\n", elapsed * 1000, elapsed > 0 ? days / elapsed : 0.0);
+    if (!all && users) {
+        printf("Balance:         ");
+        if (had_cache && before != after) {
+            print_time_diff((int)before);
+            printf(" -> ");
+        }
+        print_time_diff((int)after);
+        printf("\n");
+    }
+    return failed ? 1 : 0;
 }
 
-void show_current_status() {
+// Record one punch of today without the menu. Only the in-progress file
+// is read and written, except to check for a completed day on "in" and
+// to store the day on "out".
+int run_punch(int argc, char *argv[]) {
+    PunchKind kind;
+    int minutes = -1;
+    if (argc < 3 || argc > 4 || !parse_punch(argv[2], &kind)) {
+        printf("Usage: worktracker punch in|lunch|back|out [HH:MM]\n");
+        return 1;
+    }
+    if (argc == 4 && !parse_punch_time(argv[3], &minutes)) {
+        printf("Invalid time: %s (use HH:MM)\n", argv[3]);
+        return 1;
+    }
+
+    int lock = lock_temp_day();
+    if (lock < 0) {
+        printf("Error: Unable to lock %s\n", temp_lock_file_path);
+        return 1;
+    }
     WorkDay day;
-    
     if (!load_temp_day(&day)) {
-        printf("\nNo day in progress.\n");
-        return;
+        day = (WorkDay){.date = get_current_date(), .state = STATE_NEW};
+        if (kind == PUNCH_IN && day_recorded(day.date, NULL)) {
+            close(lock);
+            printf("Error: Today is already recorded (use Modify entry to change it)\n");
+            return 1;
+        }
     }
-    
-    printf("\n╔════════════════════════════════════════╗\n");
-    printf("║        DAY IN PROGRESS                 ║\n");
-    printf("╚════════════════════════════════════════╝\n");
-    printf("\nDate: %s\n", day.date);
-    
-    if (day.state >= STATE_STARTED) {
-        printf("✓ Arrival: %02d:%02d\n", day.start_hour, day.start_min);
+    if (minutes < 0) {
+        minutes = minutes_since(day.date);
     }
-    
-    if (day.state >= STATE_LUNCH_START) {
-        printf("✓ Lunch start: %02d:%02d\n", day.lunch_start_hour, day.lunch_start_min);
+
+    const char *error = apply_punch(&day, kind, minutes);
+    int saved = !error && save_punch(&day);
+    close(lock);
+    if (error) {
+        printf("Error: %s\n", error);
+        return 1;
     }
-    
-    if (day.state >= STATE_LUNCH_END) {
-        printf("✓ Lunch end: %02d:%02d\n", day.lunch_end_hour, day.lunch_end_min);
-        
-        // Recalculate expected end time
-        int required_minutes = REQUIRED_HOURS * 60 + REQUIRED_MINUTES;
-        int lunch_duration = time_to_minutes(day.lunch_end_hour, day.lunch_end_min) - 
-                             time_to_minutes(day.lunch_start_hour, day.lunch_start_min);
-        int start_minutes = time_to_minutes(day.start_hour, day.start_min);
-        int end_minutes = start_minutes + required_minutes + lunch_duration;
-        int end_hour, end_min;
-        minutes_to_time(end_minutes, &end_hour, &end_min);
-        
-        printf("\n→ Expected end time: %02d:%02d\n", end_hour, end_min);
+    if (!saved) {
+        printf("Error: Unable to save data\n");
+        return 1;
     }
-    
-    printf("\nNext step: ");
-    switch (day.state) {
-        case STATE_NEW:
-            printf("Record arrival time\n");
-            break;
-        case STATE_STARTED:
-            printf("Record lunch break start\n");
-            break;
-        case STATE_LUNCH_START:
-            printf("Record lunch break end\n");
-            break;
-        case STATE_LUNCH_END:
-            printf("Record departure time\n");
-            break;
-        default:
-            printf("Unknown\n");
+
+    char text[8];
+    format_punch(day.punches[day.punch_count - 1], text);
+    printf("✓ Punched %s at %s", punch_names[kind], text);
+    if (day.state == STATE_LUNCH_END) {
+        format_punch(expected_end_minutes(&day), text);
+        printf(", expected end %s", text);
+    } else if (day.state == STATE_COMPLETED) {
+        printf(", worked %02d:%02d (", day.worked_minutes / 60, day.worked_minutes % 60);
+        print_time_diff(day.excess_minutes);
+        printf(")");
     }
+    printf("\n");
+    return 0;
 }
 
-void show_history() {
-    FILE *file = fopen(data_file_path, "rb");
-    WorkDay temp_day;
-    int has_temp = load_temp_day(&temp_day);
-    
-    if (!file && !has_temp) {
-        printf("\nNo history found.\n");
-        return;
+// Today's state, worked time and expected end for prompts and status
+// bars. Reads the status record only, unless a punch came since.
+int run_status(int argc, char *argv[]) {
+    const char *format = NULL;
+    for (int i = 2; i < argc; i++) {
+        if (!(format = option_value(argc, argv, &i, "--format")) ||
+            (strcmp(format, "short") != 0 && strcmp(format, "json") != 0)) {
+            printf("Usage: worktracker status [--format short|json]\n");
+            return 1;
+        }
     }
-    
-    WorkDay day;
-    int total_excess = 0;
-    int count = 0;
-    
-    printf("\n========================================================================================================\n");
-    printf("Date       | Start  | Lunch      | End    | Time worked     | Required | Difference\n");
-    printf("========================================================================================================\n");
-    
-    // Read all completed days from file
-    if (file) {
-        while (fread(&day, sizeof(WorkDay), 1, file) == 1) {
-            printf("%s | %02d:%02d  | %02d:%02d-%02d:%02d | %02d:%02d  | %02d:%02d           | %02d:%02d    | ",
-                   day.date,
-                   day.start_hour, day.start_min,
-                   day.lunch_start_hour, day.lunch_start_min,
-                   day.lunch_end_hour, day.lunch_end_min,
-                   day.end_hour, day.end_min,
-                   day.worked_minutes / 60, day.worked_minutes % 60,
-                   REQUIRED_HOURS, REQUIRED_MINUTES);
-            
-            print_time_diff(day.excess_minutes);
-            printf("\n");
-            
-            total_excess += day.excess_minutes;
-            count++;
+    if (!format) {
+        show_current_status();
+        return 0;
+    }
+
+    StatusRecord record;
+    int today = get_current_date();
+    if (!load_status(&record) || record.date != today || record.schedule != schedule_hash()) {
+        WorkDay day;
+        if (!load_temp_day(&day) && !day_recorded(today, &day)) {
+            day = (WorkDay){.date = today, .state = STATE_NEW};
         }
-        fclose(file);
+        status_record(&day, &record);
+        save_status(&day);
     }
-    
-    // Show day in progress if it exists
-    if (has_temp) {
-        printf("%s | ", temp_day.date);
-        
-        // Show what's been recorded
-        if (temp_day.state >= STATE_STARTED) {
-            printf("%02d:%02d  | ", temp_day.start_hour, temp_day.start_min);
+
+    DayStatus status;
+    status_at(&record, minutes_since(record.date), &status);
+    char end[8] = "-";
+    if (status.expected_end >= 0) {
+        format_punch(status.expected_end, end);
+    }
+
+    if (strcmp(format, "short") == 0) {
+        printf("%s %02d:%02d %s\n", state_names[status.state], status.worked / 60, status.worked % 60, end);
+    } else {
+        char date[11];
+        format_date(record.date, date);
+        printf("{\"state\":\"%s\",\"date\":\"%s\",\"worked_minutes\":%d,\"worked\":\"%02d:%02d\",",
+               state_names[status.state], date, status.worked, status.worked / 60, status.worked % 60);
+        if (status.expected_end >= 0) {
+            printf("\"expected_end\":\"%s\"}\n", end);
         } else {
-            printf("--:--  | ");
+            printf("\"expected_end\":null}\n");
         }
-        
-        if (temp_day.state >= STATE_LUNCH_START && temp_day.state >= STATE_LUNCH_END) {
-            printf("%02d:%02d-%02d:%02d | ", 
-                   temp_day.lunch_start_hour, temp_day.lunch_start_min,
-                   temp_day.lunch_end_hour, temp_day.lunch_end_min);
-        } else if (temp_day.state >= STATE_LUNCH_START) {
-            printf("%02d:%02d-??:?? | ", 
-                   temp_day.lunch_start_hour, temp_day.lunch_start_min);
-        } else {
-            printf("--:-----:-- | ");
+    }
+    return 0;
+}
+
+// Run a non-interactive command. Returns the process exit status.
+int run_command(int argc, char *argv[]) {
+    const char *command = argv[1];
+
+    if (strcmp(command, "punch") == 0) {
+        return run_punch(argc, argv);
+    }
+
+    if (strcmp(command, "status") == 0) {
+        return run_status(argc, argv);
+    }
+
+    if (strcmp(command, "import") == 0) {
+        if (argc != 3) {
+            printf("Usage: worktracker import FILE\n");
+            return 1;
         }
-        
-        if (temp_day.state >= STATE_LUNCH_END) {
-            // Calculate expected end time
-            int required_minutes = REQUIRED_HOURS * 60 + REQUIRED_MINUTES;
-            int lunch_duration = time_to_minutes(temp_day.lunch_end_hour, temp_day.lunch_end_min) - 
-                                 time_to_minutes(temp_day.lunch_start_hour, temp_day.lunch_start_min);
-            int start_minutes = time_to_minutes(temp_day.start_hour, temp_day.start_min);
-            int end_minutes = start_minutes + required_minutes + lunch_duration;
-            int end_hour, end_min;
-            minutes_to_time(end_minutes, &end_hour, &end_min);
-            
-            printf("~%02d:%02d | ", end_hour, end_min);
-        } else {
-            printf("??:?? | ");
+        return import_days(argv[2]) ? 0 : 1;
+    }
+
+    if (strcmp(command, "export") == 0) {
+        return run_export(argc, argv);
+    }
+
+    if (strcmp(command, "report") == 0) {
+        return run_report(argc, argv);
+    }
+
+    if (strcmp(command, "balance") == 0) {
+        return show_balance() ? 0 : 1;
+    }
+
+    if (strcmp(command, "team") == 0) {
+        return run_team(argc, argv);
+    }
+
+    if (strcmp(command, "recompute") == 0) {
+        return run_recompute(argc, argv);
+    }
+
+    if (strcmp(command, "undo") == 0 || strcmp(command, "redo") == 0) {
+        if (argc != 2) {
+            printf("Usage: worktracker %s\n", command);
+            return 1;
         }
-        
-        printf("IN PROGRESS     | %02d:%02d    | IN PROGRESS\n", REQUIRED_HOURS, REQUIRED_MINUTES);
+        return move_history(command[0] == 'u' ? HISTORY_UNDO : HISTORY_REDO, 0) ? 0 : 1;
     }
-    
-    printf("========================================================================================================\n");
-    
-    if (count > 0) {
-        printf("TOTAL MONTH EXCESS: ");
-        print_time_diff(total_excess);
-        if (has_temp) {
-            printf(" (excluding day in progress)");
+
+    if (strcmp(command, "restore") == 0) {
+        return run_restore(argc, argv);
+    }
+
+    if (strcmp(command, "snapshot") == 0 || strcmp(command, "compact") == 0) {
+        return run_snapshot(argc, argv);
+    }
+
+    if (strcmp(command, "log") == 0) {
+        if (argc != 2) {
+            printf("Usage: worktracker log\n");
+            return 1;
         }
-        printf("\n"); 
+        return show_change_log(20) ? 0 : 1;
     }
-    
-    printf("========================================================================================================\n");
-}
 
-void reset_data() {
-    printf("\nAre you sure you want to delete all data? (y/n): ");
-    char choice;
-    scanf("%c", &choice);
-    clear_input_buffer();
-    
-    if (choice == 'y' || choice == 'Y') {
-        remove(data_file_path);
-        remove(temp_file_path);
-        printf("✓ Data deleted.\n");
+    if (strcmp(command, "--daemon") == 0) {
+        return run_daemon();
+    }
+
+    if (strcmp(command, "help") == 0 || strcmp(command, "--help") == 0) {
+        print_usage();
+        return 0;
     }
+
+    printf("Unknown command: %s\n\n", command);
+    print_usage();
+    return 1;
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+    // Options that pick the data directory come before the command
+    const char *store = NULL, *user = NULL;
+    int first = 1;
+    while (first < argc) {
+        const char *value;
+        if ((value = option_value(argc, argv, &first, "--store"))) {
+            store = value;
+        } else if ((value = option_value(argc, argv, &first, "--user"))) {
+            user = value;
+        } else {
+            break;
+        }
+        first++;
+    }
+
     // Initialize file paths
-    init_paths();
+    if (!init_paths(store, user)) {
+        return 1;
+    }
+    
+    if (first < argc) {
+        argv[first - 1] = argv[0];
+        return run_command(argc - first + 1, argv + first - 1);
+    }
     
     // Install signal handler for Ctrl+C
     signal(SIGINT, signal_handler);
@@ -980,12 +5561,15 @@ int main() {
         
         printf("\nChoice: ");
         
-        if (scanf("%d", &choice) != 1) {
-            clear_input_buffer();
+        if (!read_number(&choice)) {
+            // A script or a closed terminal ran out of answers
+            if (input.ended) {
+                printf("\n");
+                return 0;
+            }
             printf("\nInvalid choice.\n");
             continue;
         }
-        clear_input_buffer();
         
         switch (choice) {
             case 1: